@@ -0,0 +1,212 @@
+"""
+reduceflicker.py
+
+This file is a part of ReduceFlicker.
+
+NumPy interface to the routines of the plugin, through the exported C function ReduceFlicker_Process.
+The arrays are passed by address (no copy) and ctypes releases the GIL during the call.
+The C interface is described in src/ReduceFlicker_API.h.
+
+    import numpy as np
+    import reduceflicker
+
+    clip = np.fromfile("luma.raw", np.uint8).reshape(-1, 1080, 1920)  # (T, H, W)
+    out = reduceflicker.reduce_flicker(clip, strength=3, threads=8)
+    outs = reduceflicker.reduce_flicker_batch([clip1, clip2, ...], strength=2)
+    print(reduceflicker.profile(1920, 1080, strength=3))  # time, hardware counters and bandwidth of the routines
+    reduceflicker.reduce_flicker_file("in.y4m", "out.y4m", strength=3, threads=0)  # mapped files, no copies
+"""
+
+import ctypes
+import os
+import sys
+import tempfile
+
+import numpy as np
+
+__all__ = ["load", "reduce_flicker", "reduce_flicker_batch", "reduce_flicker_file", "profile"]
+
+_lib = None
+
+
+def load(path=None):
+    """Loads the plugin library: path, $REDUCEFLICKER_LIB or the library next to this file."""
+    global _lib
+    if path is None:
+        path = os.environ.get("REDUCEFLICKER_LIB")
+    if path is None:
+        name = "ReduceFlicker.dll" if sys.platform == "win32" else "libreduceflicker.so"
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+    lib = ctypes.CDLL(path)
+    fn = lib.ReduceFlicker_Process
+    fn.restype = ctypes.c_int
+    fn.argtypes = [
+        ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_int),  # dst, dpitch
+        ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_int),  # src, spitch
+        ctypes.c_int, ctypes.c_int, ctypes.c_int,  # num_frames, first, last
+        ctypes.c_int, ctypes.c_int, ctypes.c_int,  # width, height, bits
+        ctypes.c_int, ctypes.c_int, ctypes.c_int,  # strength, aggressive, opt
+    ]
+    fn = lib.ReduceFlicker_ProcessBatch
+    fn.restype = ctypes.c_int
+    fn.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]  # streams, num_streams, threads, opt
+    fn = lib.ReduceFlicker_Profile
+    fn.restype = ctypes.c_int
+    fn.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]  # width, height, num_frames, strength, opt, path
+    fn = lib.ReduceFlicker_ProcessFile
+    fn.restype = ctypes.c_int
+    fn.argtypes = [
+        ctypes.c_char_p, ctypes.c_char_p,  # src_path, dst_path
+        ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,  # width, height, chroma, bits
+        ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,  # strength, aggressive, threads, opt
+    ]
+    _lib = lib
+    return lib
+
+
+def _planes(frames, what):
+    """Address and pitch of each 2-D plane; the rows must be contiguous, the planes are never copied."""
+    planes = list(frames)
+    if not planes:
+        raise ValueError(f"{what}: no frames")
+    shape, dtype = planes[0].shape, planes[0].dtype
+    ptrs, pitches = [], []
+    for p in planes:
+        if not isinstance(p, np.ndarray) or p.ndim != 2 or p.shape != shape or p.dtype != dtype:
+            raise ValueError(f"{what}: frames must be 2-D arrays of the same shape and dtype")
+        if p.strides[1] != p.itemsize or p.strides[0] < p.shape[1] * p.itemsize:
+            raise ValueError(f"{what}: the rows of a frame must be contiguous")
+        ptrs.append(p.ctypes.data)
+        pitches.append(p.strides[0])
+    return planes, ptrs, pitches
+
+
+class Stream(ctypes.Structure):
+    """ReduceFlickerStream of ReduceFlicker_API.h."""
+    _fields_ = [
+        ("dst", ctypes.POINTER(ctypes.c_void_p)), ("dpitch", ctypes.POINTER(ctypes.c_int)),
+        ("src", ctypes.POINTER(ctypes.c_void_p)), ("spitch", ctypes.POINTER(ctypes.c_int)),
+        ("num_frames", ctypes.c_int), ("first", ctypes.c_int), ("last", ctypes.c_int),
+        ("width", ctypes.c_int), ("height", ctypes.c_int), ("bits", ctypes.c_int),
+        ("strength", ctypes.c_int), ("aggressive", ctypes.c_int),
+    ]
+
+
+def _stream(frames, strength, aggressive, bits, first, last, out):
+    """Checks the arrays of a clip and returns its Stream (the address arrays are kept in it) and out."""
+    src, sptrs, spitches = _planes(frames, "frames")
+    num_frames = len(src)
+    height, width = src[0].shape
+    dtype = src[0].dtype
+    if last is None:
+        last = num_frames - 1
+    if not 0 <= first <= last < num_frames:
+        raise ValueError("first and last must be within the frames, first <= last")
+
+    if dtype == np.uint8:
+        bits = 8
+    elif dtype == np.uint16:
+        bits = 16 if bits is None else bits
+        if not 9 <= bits <= 16:
+            raise ValueError("bits must be between 9..16 for uint16")
+    elif dtype == np.float32:
+        bits = 32
+    else:
+        raise ValueError("frames must be uint8, uint16 or float32")
+
+    if out is None:
+        out = np.empty((last - first + 1, height, width), dtype)
+    dst, dptrs, dpitches = _planes(out, "out")
+    if len(dst) != last - first + 1 or dst[0].shape != (height, width) or dst[0].dtype != dtype:
+        raise ValueError("out must hold last - first + 1 frames of the input shape and dtype")
+
+    s = Stream()
+    s._arrays = (
+        (ctypes.c_void_p * len(dptrs))(*dptrs), (ctypes.c_int * len(dpitches))(*dpitches),
+        (ctypes.c_void_p * num_frames)(*sptrs), (ctypes.c_int * num_frames)(*spitches),
+    )
+    s.dst, s.dpitch, s.src, s.spitch = (ctypes.cast(x, t) for x, t in zip(s._arrays, (
+        ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_int))))
+    s.num_frames, s.first, s.last = num_frames, first, last
+    s.width, s.height, s.bits = width, height, bits
+    s.strength, s.aggressive = strength, int(bool(aggressive))
+    return s, out
+
+
+def reduce_flicker(frames, strength=2, aggressive=False, opt=-1, bits=None, first=0, last=None, out=None, threads=1):
+    """
+    Filters frames first..last of frames, a (T, H, W) array or a sequence of (H, W) arrays
+    (uint8, uint16 or float32). The neighbours are clamped to the whole sequence.
+
+    bits: bit depth of uint16 samples (default 16). With 9..15 the SSE2 routine uses signed 16-bit arithmetic,
+    the samples must not exceed 2 ** bits - 1.
+    out: (last - first + 1, H, W) array or sequence of (H, W) arrays receiving the output,
+    allocated when None. It must not overlap frames.
+    threads: number of threads (the output doesn't depend on it, 0: one per core).
+    Returns out.
+    """
+    if _lib is None:
+        load()
+
+    s, out = _stream(frames, strength, aggressive, bits, first, last, out)
+    if threads == 1:
+        r = _lib.ReduceFlicker_Process(s.dst, s.dpitch, s.src, s.spitch, s.num_frames, s.first, s.last, s.width, s.height, s.bits, s.strength, s.aggressive, opt)
+    else:
+        r = _lib.ReduceFlicker_ProcessBatch(ctypes.byref(s), 1, threads, opt)
+    if r != 0:
+        raise ValueError("ReduceFlicker: invalid parameters (strength must be 1..8, opt must be supported by the CPU)")
+    return out
+
+
+def reduce_flicker_batch(clips, strength=2, aggressive=False, opt=-1, bits=None, threads=0):
+    """
+    Filters many clips (each a (T, H, W) array or a sequence of (H, W) arrays, one plane) in one call.
+    The frames of all the clips are shared by one pool of threads (0: one per core).
+    Returns the list of the outputs.
+    """
+    if _lib is None:
+        load()
+
+    streams, outs = [], []
+    for clip in clips:
+        s, out = _stream(clip, strength, aggressive, bits, 0, None, None)
+        streams.append(s)
+        outs.append(out)
+    arr = (Stream * len(streams))(*streams)
+    if _lib.ReduceFlicker_ProcessBatch(arr, len(streams), threads, opt) != 0:
+        raise ValueError("ReduceFlicker: invalid parameters (strength must be 1..8, opt must be supported by the CPU)")
+    return outs
+
+
+def reduce_flicker_file(src, dst, strength=2, aggressive=False, width=0, height=0, chroma=420, bits=8, threads=0, opt=-1):
+    """
+    Filters the file src (.y4m, or raw planar .yuv frames) into dst, in the same format (ReduceFlicker_ProcessFile).
+    Both files are mapped in memory, the frames are never copied.
+    Raw files: width, height, chroma (420, 422, 444 or 400) and bits (8..16 or 32 for float) describe the frames,
+    Y4M files give them in their header.
+    """
+    if _lib is None:
+        load()
+
+    if _lib.ReduceFlicker_ProcessFile(os.fsencode(src), os.fsencode(dst), width, height, chroma, bits, strength, int(bool(aggressive)), threads, opt) != 0:
+        raise ValueError("ReduceFlicker: invalid parameters, unsupported or truncated file")
+
+
+def profile(width=1920, height=1080, frames=16, strength=0, opt=-1):
+    """
+    Measures the routines on synthetic frames (ReduceFlicker_Profile of ReduceFlicker_API.h) and returns the table:
+    time, cycles, IPC and last level cache misses per pixel (Linux), bytes per pixel and bandwidth against a large copy.
+    strength: 0 for 1..8. opt: -1 for all the supported instruction sets.
+    """
+    if _lib is None:
+        load()
+
+    fd, path = tempfile.mkstemp(suffix=".txt")
+    os.close(fd)
+    try:
+        if _lib.ReduceFlicker_Profile(width, height, frames, strength, opt, path.encode()) != 0:
+            raise ValueError("ReduceFlicker: invalid parameters or not enough memory")
+        with open(path) as f:
+            return f.read()
+    finally:
+        os.remove(path)
@@ -20,7 +20,37 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
 */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "ReduceFlicker.h"
+#if REDUCEFLICKER_X86
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#include <xmmintrin.h>
+#endif
+#ifndef REDUCEFLICKER_EXPORTS
+#define REDUCEFLICKER_EXPORTS
+#endif
+#include "ReduceFlicker_API.h"
 
 template <typename T>
 static F_INLINE T absdiff(const T x, const T y)
@@ -28,6 +58,13 @@ static F_INLINE T absdiff(const T x, const T y)
     return x < y ? y - x : x - y;
 }
 
+// same result as the generic one (y - x == -(x - y)), without the select that gcc keeps as a branch.
+template <>
+F_INLINE float absdiff(const float x, const float y)
+{
+    return std::abs(x - y);
+}
+
 template <typename T>
 static F_INLINE T get_avg(T a, T b, T x)
 {
@@ -41,47 +78,108 @@ F_INLINE float get_avg(float a, float b, float x)
     return (a + b + x + x) * 0.25f;
 }
 
-template <typename T0, int STRENGTH>
-static void proc_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept
+template <typename T0, int STORE, typename T1>
+static F_INLINE store_t<T0, STORE> convert(T1 val, int x, int y, const OutputParams* op)
 {
-    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+
+    if constexpr (store_mode(STORE) == STORE_STREAM || store_mode(STORE) == STORE_CACHED)
+        return static_cast<TO>(val);
+    else if constexpr (std::is_integral_v<T0>)
+        return static_cast<TO>(min((val + op->ioffs[y & 7][x & 7]) >> op->shift, op->peak));
+    else
+        return static_cast<TO>(clamp(val * op->scale + op->foffs[y & 7][x & 7], 0.0f, static_cast<float>(op->peak)));
+}
+
+// Statistics of a plane (STORE_STATS), added to op->stats when the kernel returns.
+template <typename T0, int STORE>
+class Stats
+{
+    using S = std::conditional_t<std::is_integral_v<T0>, int64_t, double>;
 
-    const T0* prv0, * prv1, * prv2, * nxt0, * nxt1, * nxt2;
+    PlaneStats* stats;
+    S diff = 0, tdiff = 0;
+    int64_t clamped = 0;
 
-    T0* dst0 = reinterpret_cast<T0*>(dstp);
-    const T0* cur0 = reinterpret_cast<const T0*>(currp);
-    prv0 = reinterpret_cast<const T0*>(prevp[0]);
-    prv1 = reinterpret_cast<const T0*>(prevp[1]);
-    nxt0 = reinterpret_cast<const T0*>(nextp[0]);
-    dstride /= sizeof(T0);
-    cstride /= sizeof(T0);
-    pstride[0] /= sizeof(T0);
-    pstride[1] /= sizeof(T0);
-    nstride[0] /= sizeof(T0);
-    if (STRENGTH > 1)
+public:
+    Stats(const OutputParams* op) noexcept : stats((STORE & STORE_STATS) ? op->stats : nullptr) {}
+
+    ~Stats()
     {
-        nxt1 = reinterpret_cast<const T0*>(nextp[1]);
-        nstride[1] /= sizeof(T0);
+        if constexpr ((STORE & STORE_STATS) != 0)
+        {
+            stats->diff += static_cast<double>(diff);
+            stats->tdiff += static_cast<double>(tdiff);
+            stats->clamped += clamped;
+        }
     }
-    if (STRENGTH > 2)
+
+    template <typename T1>
+    F_INLINE void operator()(T1 val, T1 cur, T1 avg, T1 prv) noexcept
     {
-        prv2 = reinterpret_cast<const T0*>(prevp[2]);
-        nxt2 = reinterpret_cast<const T0*>(nextp[2]);
-        pstride[2] /= sizeof(T0);
-        nstride[2] /= sizeof(T0);
+        if constexpr ((STORE & STORE_STATS) != 0)
+        {
+            diff += absdiff(val, cur);
+            tdiff += absdiff(cur, prv);
+            clamped += val != avg;
+        }
     }
+};
+
+// Bound of the pixels (STORE_BOUND): written to op->bound in the input format, max(d1, d2) when aggressive.
+template <typename T0, int STORE>
+static F_INLINE T0* bound_line(const OutputParams* op, int y)
+{
+    if constexpr ((STORE & STORE_BOUND) != 0)
+        return reinterpret_cast<T0*>(op->bound + static_cast<size_t>(op->bstride) * y);
+    else
+        return nullptr;
+}
+
+template <int STORE, typename T0, typename T1>
+static F_INLINE void store_bound(T0* bnd, int x, T1 d1, T1 d2)
+{
+    if constexpr ((STORE & STORE_BOUND) != 0)
+        bnd[x] = static_cast<T0>(max(d1, d2));
+}
+
+// Row y of a plane.
+template <typename T>
+static F_INLINE const T* line(const uint8_t* p, int stride, int y)
+{
+    return reinterpret_cast<const T*>(p + static_cast<size_t>(stride) * y);
+}
+
+// The C routines are written without data-dependent branches so that the compiler can vectorize the x loops.
+// dstp may be currp (inplace), so the rows of dstp and currp aren't __restrict.
+template <typename T0, int STRENGTH, int STORE>
+static void proc_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+    Stats<T0, STORE> st(op);
 
     for (int y = 0; y < height; ++y)
     {
+        TO* dst0 = reinterpret_cast<TO*>(dstp + static_cast<size_t>(dstride) * y);
+        T0* __restrict bnd0 = bound_line<T0, STORE>(op, y);
+        const T0* cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp[0], pstride[0], y);
+        const T0* __restrict prv1 = line<T0>(prevp[1], pstride[1], y);
+        const T0* __restrict nxt0 = line<T0>(nextp[0], nstride[0], y);
+        const T0* __restrict nxt1 = STRENGTH > 1 ? line<T0>(nextp[1], nstride[1], y) : nullptr;
+        const T0* __restrict prv2 = STRENGTH > 2 ? line<T0>(prevp[2], pstride[2], y) : nullptr;
+        const T0* __restrict nxt2 = STRENGTH > 2 ? line<T0>(nextp[2], nstride[2], y) : nullptr;
+
         for (int x = 0; x < width; ++x)
         {
             const T1 curx = static_cast<T1>(cur0[x]);
             T1 d = absdiff(curx, static_cast<T1>(prv1[x]));
-            if (STRENGTH > 1)
+            if constexpr (STRENGTH > 1)
             {
                 d = min(d, absdiff(curx, static_cast<T1>(nxt1[x])));
             }
-            if (STRENGTH > 2)
+            if constexpr (STRENGTH > 2)
             {
                 d = min(d, absdiff(curx, static_cast<T1>(prv2[x])));
                 d = min(d, absdiff(curx, static_cast<T1>(nxt2[x])));
@@ -91,88 +189,61 @@ static void proc_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, c
             T1 avg = get_avg(prvx, nxtx, curx);
             T1 ul = max(min(prvx, nxtx) - d, curx);
             T1 ll = min(max(prvx, nxtx) + d, curx);
-            dst0[x] = static_cast<T0>(clamp(avg, ll, ul));
-        }
-        dst0 += dstride;
-        cur0 += cstride;
-        prv0 += pstride[0];
-        prv1 += pstride[1];
-        nxt0 += nstride[0];
-        if (STRENGTH > 1)
-        {
-            nxt1 += nstride[1];
-        }
-        if (STRENGTH > 2)
-        {
-            prv2 += pstride[2];
-            nxt2 += nstride[2];
+            const T1 val = clamp(avg, ll, ul);
+            st(val, curx, avg, prvx);
+            store_bound<STORE>(bnd0, x, d, d);
+            dst0[x] = convert<T0, STORE>(val, x, y, op);
         }
     }
 }
 
+// d1: smallest difference x - y >= 0, 0 once a difference is negative.
+// d2: smallest difference y - x > 0, 0 once a difference is not negative.
+template <typename T>
+static F_INLINE void init_diff(T x, T y, T& d1, T& d2)
+{
+    const T d = x - y;
+    d1 = max(d, static_cast<T>(0));
+    d2 = max(-d, static_cast<T>(0));
+}
+
 template <typename T>
 static F_INLINE void update_diff(T x, T y, T& d1, T& d2)
 {
-    T d = x - y;
-    if (d >= 0)
-    {
-        d2 = 0;
-        d1 = min(d, d1);
-    }
-    else
-    {
-        d1 = 0;
-        d2 = min(-d, d2);
-    }
+    const T d = x - y;
+    d1 = min(max(d, static_cast<T>(0)), d1);
+    d2 = min(max(-d, static_cast<T>(0)), d2);
 }
 
-template <typename T0, int STRENGTH>
-static void proc_a_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept
+template <typename T0, int STRENGTH, int STORE>
+static void proc_a_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
 {
     using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
-
-    const T0* prv0, * prv1, * prv2, * nxt0, * nxt1, * nxt2;
-
-    T0* dst0 = reinterpret_cast<T0*>(dstp);
-    const T0* cur0 = reinterpret_cast<const T0*>(currp);
-    prv0 = reinterpret_cast<const T0*>(prevp[0]);
-    prv1 = reinterpret_cast<const T0*>(prevp[1]);
-    nxt0 = reinterpret_cast<const T0*>(nextp[0]);
-    dstride /= sizeof(T0);
-    cstride /= sizeof(T0);
-    pstride[0] /= sizeof(T0);
-    pstride[1] /= sizeof(T0);
-    nstride[0] /= sizeof(T0);
-    if (STRENGTH > 1)
-    {
-        nxt1 = reinterpret_cast<const T0*>(nextp[1]);
-        nstride[1] /= sizeof(T0);
-    }
-    if (STRENGTH > 2)
-    {
-        prv2 = reinterpret_cast<const T0*>(prevp[2]);
-        nxt2 = reinterpret_cast<const T0*>(nextp[2]);
-        pstride[2] /= sizeof(T0);
-        nstride[2] /= sizeof(T0);
-    }
+    using TO = store_t<T0, STORE>;
+    Stats<T0, STORE> st(op);
 
     for (int y = 0; y < height; ++y)
     {
+        TO* dst0 = reinterpret_cast<TO*>(dstp + static_cast<size_t>(dstride) * y);
+        T0* __restrict bnd0 = bound_line<T0, STORE>(op, y);
+        const T0* cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp[0], pstride[0], y);
+        const T0* __restrict prv1 = line<T0>(prevp[1], pstride[1], y);
+        const T0* __restrict nxt0 = line<T0>(nextp[0], nstride[0], y);
+        const T0* __restrict nxt1 = STRENGTH > 1 ? line<T0>(nextp[1], nstride[1], y) : nullptr;
+        const T0* __restrict prv2 = STRENGTH > 2 ? line<T0>(prevp[2], pstride[2], y) : nullptr;
+        const T0* __restrict nxt2 = STRENGTH > 2 ? line<T0>(nextp[2], nstride[2], y) : nullptr;
+
         for (int x = 0; x < width; ++x)
         {
             const T1 curx = static_cast<T1>(cur0[x]);
-            T1 d1 = prv1[x] - curx;
-            T1 d2 = 0;
-            if (d1 < 0)
-            {
-                d2 = -d1;
-                d1 = 0;
-            }
-            if (STRENGTH > 1)
+            T1 d1, d2;
+            init_diff(static_cast<T1>(prv1[x]), curx, d1, d2);
+            if constexpr (STRENGTH > 1)
             {
                 update_diff(static_cast<T1>(nxt1[x]), curx, d1, d2);
             }
-            if (STRENGTH > 2)
+            if constexpr (STRENGTH > 2)
             {
                 update_diff(static_cast<T1>(prv2[x]), curx, d1, d2);
                 update_diff(static_cast<T1>(nxt2[x]), curx, d1, d2);
@@ -182,353 +253,2424 @@ static void proc_a_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp,
             T1 avg = get_avg(prvx, nxtx, curx);
             T1 ul = max(min(prvx, nxtx) - d1, curx);
             T1 ll = min(max(prvx, nxtx) + d2, curx);
-            dst0[x] = static_cast<T0>(clamp(avg, ll, ul));
-        }
-        dst0 += dstride;
-        cur0 += cstride;
-        prv0 += pstride[0];
-        prv1 += pstride[1];
-        nxt0 += nstride[0];
-        if (STRENGTH > 1)
-        {
-            nxt1 += nstride[1];
-        }
-        if (STRENGTH > 2)
-        {
-            prv2 += pstride[2];
-            nxt2 += nstride[2];
+            const T1 val = clamp(avg, ll, ul);
+            st(val, curx, avg, prvx);
+            store_bound<STORE>(bnd0, x, d1, d2);
+            dst0[x] = convert<T0, STORE>(val, x, y, op);
         }
     }
 }
 
-ReduceFlicker::ReduceFlicker(PClip c, int s, bool aggressive, bool grey, int opt, bool ra, bool luma, IScriptEnvironment* env) :
-    GenericVideoFilter(c), strength(s), _grey(grey), opt_(opt), raccess(ra), _luma(luma)
-{
-    has_at_least_v8 = true;
-    try { env->CheckVersion(8); }
-    catch (const AvisynthError&) { has_at_least_v8 = false; }
+// runtime-radius C routines: the bounds of a block of columns are built one reference at a time.
+constexpr int C_BLOCK = 256;
 
-    int planecount = min(vi.NumComponents(), 3);
-    for (int i = 0; i < planecount; ++i)
-    {
-        if (vi.IsRGB())
-            processPlane[i] = true;
-        else if (i == 0)
-            processPlane[i] = _luma;
-        else
-            processPlane[i] = !_grey;
-    }
+// strength > 3: the bound is the minimum of the absdiffs against n - 2 .. n - strength and n + 2 .. n + strength.
+template <typename T0, int STORE>
+static void proc_r_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+    Stats<T0, STORE> st(op);
 
-    avx2 = ((!!(env->GetCPUFlags() & CPUF_AVX2) && opt_ < 0) || opt_ == 2);
-    sse2 = ((!!(env->GetCPUFlags() & CPUF_SSE2) && opt_ < 0) || opt_ == 1);
+    T1 bound[C_BLOCK];
 
-    align = avx2 ? 32 : 16;
+    for (int y = 0; y < height; ++y)
+    {
+        TO* dst0 = reinterpret_cast<TO*>(dstp + static_cast<size_t>(dstride) * y);
+        T0* __restrict bnd0 = bound_line<T0, STORE>(op, y);
+        const T0* cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp[0], pstride[0], y);
+        const T0* __restrict nxt0 = line<T0>(nextp[0], nstride[0], y);
 
-    if (avx2 && !aggressive)
-        switch (vi.ComponentSize())
-        {
-            case 1:
-                switch (strength)
-                {
-                    case 1: process = proc_avx2<uint8_t, 1>; break;
-                    case 2: process = proc_avx2<uint8_t, 2>; break;
-                    default: process = proc_avx2<uint8_t, 3>; break;
-                }
-                break;
-            case 2:
-                switch (strength)
-                {
-                    case 1: process = proc_avx2<uint16_t, 1>; break;
-                    case 2: process = proc_avx2<uint16_t, 2>; break;
-                    default: process = proc_avx2<uint16_t, 3>; break;
-                }
-                break;
-            default:
-                switch (strength)
-                {
-                    case 1: process = proc_avx2<float, 1>; break;
-                    case 2: process = proc_avx2<float, 2>; break;
-                    default: process = proc_avx2<float, 3>; break;
-                }
-                break;
-        }
-    else if (avx2 && aggressive)
-        switch (vi.ComponentSize())
-        {
-            case 1:
-                switch (strength)
-                {
-                    case 1: process = proc_a_avx2<uint8_t, 1>; break;
-                    case 2: process = proc_a_avx2<uint8_t, 2>; break;
-                    default: process = proc_a_avx2<uint8_t, 3>; break;
-                }
-                break;
-            case 2:
-                switch (strength)
-                {
-                    case 1: process = proc_a_avx2<uint16_t, 1>; break;
-                    case 2: process = proc_a_avx2<uint16_t, 2>; break;
-                    default: process = proc_a_avx2<uint16_t, 3>; break;
-                }
-                break;
-            default:
-                switch (strength)
-                {
-                    case 1: process = proc_a_avx2<float, 1>; break;
-                    case 2: process = proc_a_avx2<float, 2>; break;
-                    default: process = proc_a_avx2<float, 3>; break;
-                }
-                break;
-        }
-    else if (sse2 && !aggressive)
-        switch (vi.ComponentSize())
+        for (int x0 = 0; x0 < width; x0 += C_BLOCK)
         {
-            case 1:
-                switch (strength)
-                {
-                    case 1: process = proc_sse2<uint8_t, 1>; break;
-                    case 2: process = proc_sse2<uint8_t, 2>; break;
-                    default: process = proc_sse2<uint8_t, 3>; break;
-                }
-                break;
-            case 2:
-                switch (strength)
+            const int w = min(width - x0, C_BLOCK);
+            const T0* cur = cur0 + x0;
+            T1* __restrict d = bound;
+
+            for (int k = 1; k < strength; ++k)
+            {
+                const T0* __restrict prv = line<T0>(prevp[k], pstride[k], y) + x0;
+                const T0* __restrict nxt = line<T0>(nextp[k], nstride[k], y) + x0;
+                if (k == 1)
                 {
-                    case 1: process = proc_sse2<uint16_t, 1>; break;
-                    case 2: process = proc_sse2<uint16_t, 2>; break;
-                    default: process = proc_sse2<uint16_t, 3>; break;
+                    for (int x = 0; x < w; ++x)
+                        d[x] = min(absdiff(static_cast<T1>(cur[x]), static_cast<T1>(prv[x])), absdiff(static_cast<T1>(cur[x]), static_cast<T1>(nxt[x])));
                 }
-                break;
-            default:
-                switch (strength)
+                else
                 {
-                    case 1: process = proc_sse2<float, 1>; break;
-                    case 2: process = proc_sse2<float, 2>; break;
-                    default: process = proc_sse2<float, 3>; break;
+                    for (int x = 0; x < w; ++x)
+                        d[x] = min(d[x], min(absdiff(static_cast<T1>(cur[x]), static_cast<T1>(prv[x])), absdiff(static_cast<T1>(cur[x]), static_cast<T1>(nxt[x]))));
                 }
-                break;
+            }
+
+            for (int x = 0; x < w; ++x)
+            {
+                const T1 curx = static_cast<T1>(cur[x]);
+                T1 prvx = static_cast<T1>(prv0[x0 + x]);
+                T1 nxtx = static_cast<T1>(nxt0[x0 + x]);
+                T1 avg = get_avg(prvx, nxtx, curx);
+                T1 ul = max(min(prvx, nxtx) - d[x], curx);
+                T1 ll = min(max(prvx, nxtx) + d[x], curx);
+                const T1 val = clamp(avg, ll, ul);
+                st(val, curx, avg, prvx);
+                store_bound<STORE>(bnd0, x0 + x, d[x], d[x]);
+                dst0[x0 + x] = convert<T0, STORE>(val, x0 + x, y, op);
+            }
         }
-    else if (sse2 && aggressive)
-        switch (vi.ComponentSize())
+    }
+}
+
+template <typename T0, int STORE>
+static void proc_ra_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+    Stats<T0, STORE> st(op);
+
+    T1 bound1[C_BLOCK], bound2[C_BLOCK];
+
+    for (int y = 0; y < height; ++y)
+    {
+        TO* dst0 = reinterpret_cast<TO*>(dstp + static_cast<size_t>(dstride) * y);
+        T0* __restrict bnd0 = bound_line<T0, STORE>(op, y);
+        const T0* cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp[0], pstride[0], y);
+        const T0* __restrict nxt0 = line<T0>(nextp[0], nstride[0], y);
+
+        for (int x0 = 0; x0 < width; x0 += C_BLOCK)
         {
-            case 1:
-                switch (strength)
-                {
-                    case 1: process = proc_a_sse2<uint8_t, 1>; break;
-                    case 2: process = proc_a_sse2<uint8_t, 2>; break;
-                    default: process = proc_a_sse2<uint8_t, 3>; break;
-                }
-                break;
-            case 2:
-                switch (strength)
+            const int w = min(width - x0, C_BLOCK);
+            const T0* cur = cur0 + x0;
+            T1* __restrict d1 = bound1;
+            T1* __restrict d2 = bound2;
+
+            for (int k = 1; k < strength; ++k)
+            {
+                const T0* __restrict prv = line<T0>(prevp[k], pstride[k], y) + x0;
+                const T0* __restrict nxt = line<T0>(nextp[k], nstride[k], y) + x0;
+                if (k == 1)
                 {
-                    case 1: process = proc_a_sse2<uint16_t, 1>; break;
-                    case 2: process = proc_a_sse2<uint16_t, 2>; break;
-                    default: process = proc_a_sse2<uint16_t, 3>; break;
+                    for (int x = 0; x < w; ++x)
+                    {
+                        init_diff(static_cast<T1>(prv[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                        update_diff(static_cast<T1>(nxt[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                    }
                 }
-                break;
-            default:
-                switch (strength)
+                else
                 {
-                    case 1: process = proc_a_sse2<float, 1>; break;
-                    case 2: process = proc_a_sse2<float, 2>; break;
-                    default: process = proc_a_sse2<float, 3>; break;
+                    for (int x = 0; x < w; ++x)
+                    {
+                        update_diff(static_cast<T1>(prv[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                        update_diff(static_cast<T1>(nxt[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                    }
                 }
-                break;
+            }
+
+            for (int x = 0; x < w; ++x)
+            {
+                const T1 curx = static_cast<T1>(cur[x]);
+                T1 prvx = static_cast<T1>(prv0[x0 + x]);
+                T1 nxtx = static_cast<T1>(nxt0[x0 + x]);
+                T1 avg = get_avg(prvx, nxtx, curx);
+                T1 ul = max(min(prvx, nxtx) - d1[x], curx);
+                T1 ll = min(max(prvx, nxtx) + d2[x], curx);
+                const T1 val = clamp(avg, ll, ul);
+                st(val, curx, avg, prvx);
+                store_bound<STORE>(bnd0, x0 + x, d1[x], d2[x]);
+                dst0[x0 + x] = convert<T0, STORE>(val, x0 + x, y, op);
+            }
         }
-    else if (!aggressive)
-        switch (vi.ComponentSize())
+    }
+}
+
+// causal mode: the bound is taken from n - 2 .. n - max(strength, 2) and the average from n - 1 only,
+// so that no frame after n is read (the symmetric routines with the next frames replaced by the previous ones).
+template <typename T0, bool AGGRESSIVE, int STORE>
+static void proc_p_c(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+    Stats<T0, STORE> st(op);
+
+    T1 bound1[C_BLOCK], bound2[C_BLOCK];
+    const int nrefs = max(strength, 2) - 1;
+
+    for (int y = 0; y < height; ++y)
+    {
+        TO* dst0 = reinterpret_cast<TO*>(dstp + static_cast<size_t>(dstride) * y);
+        T0* __restrict bnd0 = bound_line<T0, STORE>(op, y);
+        const T0* cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp[0], pstride[0], y);
+
+        for (int x0 = 0; x0 < width; x0 += C_BLOCK)
         {
-            case 1:
-                switch (strength)
+            const int w = min(width - x0, C_BLOCK);
+            const T0* cur = cur0 + x0;
+            T1* __restrict d1 = bound1;
+            T1* __restrict d2 = bound2;
+
+            for (int k = 1; k <= nrefs; ++k)
+            {
+                const T0* __restrict prv = line<T0>(prevp[k], pstride[k], y) + x0;
+                if constexpr (AGGRESSIVE)
                 {
-                    case 1: process = proc_c<uint8_t, 1>; break;
-                    case 2: process = proc_c<uint8_t, 2>; break;
-                    default: process = proc_c<uint8_t, 3>; break;
+                    if (k == 1)
+                    {
+                        for (int x = 0; x < w; ++x)
+                            init_diff(static_cast<T1>(prv[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                    }
+                    else
+                    {
+                        for (int x = 0; x < w; ++x)
+                            update_diff(static_cast<T1>(prv[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                    }
                 }
-                break;
-            case 2:
-                switch (strength)
+                else if (k == 1)
                 {
-                    case 1: process = proc_c<uint16_t, 1>; break;
-                    case 2: process = proc_c<uint16_t, 2>; break;
-                    default: process = proc_c<uint16_t, 3>; break;
+                    for (int x = 0; x < w; ++x)
+                        d1[x] = absdiff(static_cast<T1>(cur[x]), static_cast<T1>(prv[x]));
                 }
-                break;
-            default:
-                switch (strength)
+                else
                 {
-                    case 1: process = proc_c<float, 1>; break;
-                    case 2: process = proc_c<float, 2>; break;
-                    default: process = proc_c<float, 3>; break;
+                    for (int x = 0; x < w; ++x)
+                        d1[x] = min(d1[x], absdiff(static_cast<T1>(cur[x]), static_cast<T1>(prv[x])));
                 }
-                break;
+            }
+
+            for (int x = 0; x < w; ++x)
+            {
+                const T1 curx = static_cast<T1>(cur[x]);
+                T1 prvx = static_cast<T1>(prv0[x0 + x]);
+                T1 avg = get_avg(prvx, prvx, curx);
+                T1 ul = max(prvx - d1[x], curx);
+                T1 ll = min(prvx + (AGGRESSIVE ? d2[x] : d1[x]), curx);
+                const T1 val = clamp(avg, ll, ul);
+                st(val, curx, avg, prvx);
+                store_bound<STORE>(bnd0, x0 + x, d1[x], AGGRESSIVE ? d2[x] : d1[x]);
+                dst0[x0 + x] = convert<T0, STORE>(val, x0 + x, y, op);
+            }
         }
-    else
-        switch (vi.ComponentSize())
+    }
+}
+
+// variants: the outputs of several strengths and modes from one pass. The bounds of a block of columns are built
+// one reference at a time in the order of the strengths (n - 2, n + 2, then n - s and n + s), and each variant is
+// written as soon as the references of its strength are in, so every reference row is read once for all of them.
+// The average and the min/max of n - 1 and n + 1 are computed once per block, a variant only adds its bound and clamps.
+template <typename T0, int STORE>
+static void proc_v_c(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+
+    T1 bound[C_BLOCK], bound1[C_BLOCK], bound2[C_BLOCK];
+    T1 lo[C_BLOCK], hi[C_BLOCK], avg[C_BLOCK];
+    int strength = 1;
+    bool plain = false, aggressive = false;
+    for (int v = 0; v < nvariants; ++v)
+    {
+        strength = max(strength, variants[v].strength);
+        plain |= !variants[v].aggressive;
+        aggressive |= variants[v].aggressive;
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        const T0* __restrict cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp[0], pstride[0], y);
+        const T0* __restrict nxt0 = line<T0>(nextp[0], nstride[0], y);
+
+        for (int x0 = 0; x0 < width; x0 += C_BLOCK)
         {
-            case 1:
-                switch (strength)
-                {
-                    case 1: process = proc_a_c<uint8_t, 1>; break;
-                    case 2: process = proc_a_c<uint8_t, 2>; break;
-                    default: process = proc_a_c<uint8_t, 3>; break;
-                }
-                break;
-            case 2:
-                switch (strength)
+            const int w = min(width - x0, C_BLOCK);
+            const T0* __restrict cur = cur0 + x0;
+            T1* __restrict d = bound;
+            T1* __restrict d1 = bound1;
+            T1* __restrict d2 = bound2;
+
+            for (int x = 0; x < w; ++x)
+            {
+                const T1 prvx = static_cast<T1>(prv0[x0 + x]);
+                const T1 nxtx = static_cast<T1>(nxt0[x0 + x]);
+                lo[x] = min(prvx, nxtx);
+                hi[x] = max(prvx, nxtx);
+                avg[x] = get_avg(prvx, nxtx, static_cast<T1>(cur[x]));
+            }
+
+            for (int s = 1; s <= strength; ++s)
+            {
+                const T0* refs[2];
+                const int nrefs = s > 2 ? 2 : 1;
+                refs[0] = s == 1 ? line<T0>(prevp[1], pstride[1], y) : s == 2 ? line<T0>(nextp[1], nstride[1], y) : line<T0>(prevp[s - 1], pstride[s - 1], y);
+                refs[1] = s > 2 ? line<T0>(nextp[s - 1], nstride[s - 1], y) : nullptr;
+
+                for (int k = 0; k < nrefs; ++k)
                 {
-                    case 1: process = proc_a_c<uint16_t, 1>; break;
-                    case 2: process = proc_a_c<uint16_t, 2>; break;
-                    default: process = proc_a_c<uint16_t, 3>; break;
+                    const T0* __restrict r = refs[k] + x0;
+                    if (s == 1)
+                    {
+                        if (plain)
+                            for (int x = 0; x < w; ++x)
+                                d[x] = absdiff(static_cast<T1>(cur[x]), static_cast<T1>(r[x]));
+                        if (aggressive)
+                            for (int x = 0; x < w; ++x)
+                                init_diff(static_cast<T1>(r[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                    }
+                    else
+                    {
+                        if (plain)
+                            for (int x = 0; x < w; ++x)
+                                d[x] = min(d[x], absdiff(static_cast<T1>(cur[x]), static_cast<T1>(r[x])));
+                        if (aggressive)
+                            for (int x = 0; x < w; ++x)
+                                update_diff(static_cast<T1>(r[x]), static_cast<T1>(cur[x]), d1[x], d2[x]);
+                    }
                 }
-                break;
-            default:
-                switch (strength)
+
+                for (int v = 0; v < nvariants; ++v)
                 {
-                    case 1: process = proc_a_c<float, 1>; break;
-                    case 2: process = proc_a_c<float, 2>; break;
-                    default: process = proc_a_c<float, 3>; break;
+                    if (variants[v].strength != s)
+                        continue;
+                    TO* __restrict dst0 = reinterpret_cast<TO*>(dstp[v] + static_cast<size_t>(dstride[v]) * y);
+                    const T1* __restrict vd1 = variants[v].aggressive ? d1 : d;
+                    const T1* __restrict vd2 = variants[v].aggressive ? d2 : d;
+                    for (int x = 0; x < w; ++x)
+                    {
+                        const T1 curx = static_cast<T1>(cur[x]);
+                        T1 ul = max(lo[x] - vd1[x], curx);
+                        T1 ll = min(hi[x] + vd2[x], curx);
+                        dst0[x0 + x] = convert<T0, STORE>(clamp(avg[x], ll, ul), x0 + x, y, op);
+                    }
                 }
-                break;
+            }
         }
+    }
 }
 
-PVideoFrame __stdcall ReduceFlicker::GetFrame(int n, IScriptEnvironment* env)
+// fast mode: 2x2 average, the last column/row are repeated when the size is odd.
+template <typename T>
+static F_INLINE T average4(T a, T b, T c, T d)
 {
-    PVideoFrame curr, prev[3], next[3];
-    const int nf = vi.num_frames - 1;
+    return static_cast<T>((a + b + c + d + 2) >> 2);
+}
 
-    if (raccess)
-        switch (strength)
-        {
-            case 3:
-                next[2] = child->GetFrame(min(n + 3, nf), env);
-                next[1] = child->GetFrame(min(n + 2, nf), env);
-                next[0] = child->GetFrame(min(n + 1, nf), env);
-                curr = child->GetFrame(n, env);
-                prev[0] = child->GetFrame(max(n - 1, 0), env);
-                prev[1] = child->GetFrame(max(n - 2, 0), env);
-                prev[2] = child->GetFrame(max(n - 3, 0), env);
-                break;
-            case 2:
-                next[1] = child->GetFrame(min(n + 2, nf), env);
-                next[0] = child->GetFrame(min(n + 1, nf), env);
-                curr = child->GetFrame(n, env);
-                prev[0] = child->GetFrame(max(n - 1, 0), env);
-                prev[1] = child->GetFrame(max(n - 2, 0), env);
-                break;
-            default:
-                next[0] = child->GetFrame(min(n + 1, nf), env);
-                curr = child->GetFrame(n, env);
-                prev[1] = child->GetFrame(max(n - 2, 0), env);
-                prev[0] = child->GetFrame(max(n - 1, 0), env);
-                break;
-        }
-    else
-        switch (strength)
-        {
-            case 3:
-                prev[2] = child->GetFrame(max(n - 3, 0), env);
-                prev[1] = child->GetFrame(max(n - 2, 0), env);
-                prev[0] = child->GetFrame(max(n - 1, 0), env);
-                curr = child->GetFrame(n, env);
-                next[0] = child->GetFrame(min(n + 1, nf), env);
-                next[1] = child->GetFrame(min(n + 2, nf), env);
-                next[2] = child->GetFrame(min(n + 3, nf), env);
-                break;
-            case 2:
-                prev[1] = child->GetFrame(max(n - 2, 0), env);
-                prev[0] = child->GetFrame(max(n - 1, 0), env);
-                curr = child->GetFrame(n, env);
-                next[0] = child->GetFrame(min(n + 1, nf), env);
-                next[1] = child->GetFrame(min(n + 2, nf), env);
-                break;
-            default:
-                prev[1] = child->GetFrame(max(n - 2, 0), env);
-                prev[0] = child->GetFrame(max(n - 1, 0), env);
-                curr = child->GetFrame(n, env);
-                next[0] = child->GetFrame(min(n + 1, nf), env);
-                break;
-        }
+template <>
+F_INLINE float average4(float a, float b, float c, float d)
+{
+    return ((a + c) + (b + d)) * 0.25f;
+}
 
-    PVideoFrame dst = has_at_least_v8 ? env->NewVideoFrameP(vi, &curr, align) : env->NewVideoFrame(vi, align);
+template <typename T>
+static void decimate_c(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    const int hwidth = (width + 1) / 2;
+    const int hheight = (height + 1) / 2;
 
-    int planes_y[4] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
-    int planes_r[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
-    const int* current_planes = !vi.IsRGB() ? planes_y : planes_r;
-    int planecount = min(vi.NumComponents(), 3);
-    for (int i = 0; i < planecount; ++i)
+    for (int y = 0; y < hheight; ++y)
     {
-        const int plane = current_planes[i];
+        T* dst = reinterpret_cast<T*>(dstp + static_cast<size_t>(dstride) * y);
+        const T* s0 = reinterpret_cast<const T*>(srcp + static_cast<size_t>(sstride) * y * 2);
+        const T* s1 = reinterpret_cast<const T*>(srcp + static_cast<size_t>(sstride) * min(y * 2 + 1, height - 1));
 
-        if (processPlane[i])
-        {
-            int width = curr->GetRowSize(plane) / vi.ComponentSize();
-            int height = curr->GetHeight(plane);
-            int cpitch = curr->GetPitch(plane);
-            int dpitch = dst->GetPitch(plane);
-            const uint8_t* currp = curr->GetReadPtr(plane);
-            uint8_t* dstp = dst->GetWritePtr(plane);
+        for (int x = 0; x < width / 2; ++x)
+            dst[x] = average4(s0[x * 2], s0[x * 2 + 1], s1[x * 2], s1[x * 2 + 1]);
+        if (width & 1)
+            dst[hwidth - 1] = average4(s0[width - 1], s0[width - 1], s1[width - 1], s1[width - 1]);
+    }
+}
+
+// fast mode: pixel (x, y) uses the bound of the 2x2 averages at (x / 2, y / 2).
+template <typename T0, bool AGGRESSIVE, int STORE>
+static void proc_f_c(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T0>, int, float>;
+    using TO = store_t<T0, STORE>;
+    Stats<T0, STORE> st(op);
+
+    // bounds of the half resolution columns of a block
+    T1 bound1[C_BLOCK / 2], bound2[C_BLOCK / 2];
+
+    for (int y = 0; y < height; ++y)
+    {
+        TO* dst0 = reinterpret_cast<TO*>(dstp + static_cast<size_t>(dstride) * y);
+        T0* __restrict bnd0 = bound_line<T0, STORE>(op, y);
+        const T0* cur0 = line<T0>(currp, cstride, y);
+        const T0* __restrict prv0 = line<T0>(prevp, pstride, y);
+        const T0* __restrict nxt0 = line<T0>(nextp, nstride, y);
 
-            const uint8_t* prevp[3], * nextp[3];
-            int ppitch[3], npitch[3];
+        for (int x0 = 0; x0 < width; x0 += C_BLOCK)
+        {
+            const int w = min(width - x0, C_BLOCK);
+            const int hw = (w + 1) / 2;
+            const T0* __restrict hcur = line<T0>(hcurrp, hstride, y >> 1) + x0 / 2;
+            T1* __restrict d1 = bound1;
+            T1* __restrict d2 = bound2;
 
-            switch (strength)
+            for (int k = 0; k < nrefs; ++k)
             {
-                case 3:
-                    prevp[2] = prev[2]->GetReadPtr(plane);
-                    ppitch[2] = prev[2]->GetPitch(plane);
-                    nextp[2] = next[2]->GetReadPtr(plane);
-                    npitch[2] = next[2]->GetPitch(plane);
-                case 2:
-                    nextp[1] = next[1]->GetReadPtr(plane);
-                    npitch[1] = next[1]->GetPitch(plane);
-                default:
-                    prevp[0] = prev[0]->GetReadPtr(plane);
-                    ppitch[0] = prev[0]->GetPitch(plane);
-                    prevp[1] = prev[1]->GetReadPtr(plane);
-                    ppitch[1] = prev[1]->GetPitch(plane);
-                    nextp[0] = next[0]->GetReadPtr(plane);
-                    npitch[0] = next[0]->GetPitch(plane);
+                const T0* __restrict href = line<T0>(hrefp[k], hstride, y >> 1) + x0 / 2;
+                if constexpr (!AGGRESSIVE)
+                {
+                    if (k == 0)
+                    {
+                        for (int x = 0; x < hw; ++x)
+                            d1[x] = absdiff(static_cast<T1>(hcur[x]), static_cast<T1>(href[x]));
+                    }
+                    else
+                    {
+                        for (int x = 0; x < hw; ++x)
+                            d1[x] = min(d1[x], absdiff(static_cast<T1>(hcur[x]), static_cast<T1>(href[x])));
+                    }
+                }
+                else if (k == 0)
+                {
+                    for (int x = 0; x < hw; ++x)
+                        init_diff(static_cast<T1>(href[x]), static_cast<T1>(hcur[x]), d1[x], d2[x]);
+                }
+                else
+                {
+                    for (int x = 0; x < hw; ++x)
+                        update_diff(static_cast<T1>(href[x]), static_cast<T1>(hcur[x]), d1[x], d2[x]);
+                }
             }
+            if constexpr (!AGGRESSIVE)
+                d2 = d1;
 
-            process(dstp, currp, prevp, nextp, dpitch, cpitch, ppitch, npitch, width, height);
+            for (int x = 0; x < w; ++x)
+            {
+                const T1 curx = static_cast<T1>(cur0[x0 + x]);
+                T1 prvx = static_cast<T1>(prv0[x0 + x]);
+                T1 nxtx = static_cast<T1>(nxt0[x0 + x]);
+                T1 avg = get_avg(prvx, nxtx, curx);
+                T1 ul = max(min(prvx, nxtx) - d1[x >> 1], curx);
+                T1 ll = min(max(prvx, nxtx) + d2[x >> 1], curx);
+                const T1 val = clamp(avg, ll, ul);
+                st(val, curx, avg, prvx);
+                store_bound<STORE>(bnd0, x0 + x, d1[x >> 1], d2[x >> 1]);
+                dst0[x0 + x] = convert<T0, STORE>(val, x0 + x, y, op);
+            }
         }
     }
-
-    return dst;
 }
 
-AVSValue __cdecl Create_ReduceFlicker(AVSValue args, void*, IScriptEnvironment* env)
+template <typename T>
+static void error_diffusion(uint8_t* dstp, const uint8_t* srcp, int width, void* err0, void* err1, const OutputParams* op) noexcept
 {
-    PClip clip = args[0].AsClip();
+    using T1 = std::conditional_t<std::is_integral_v<T>, int, float>;
+
+    const T* src = reinterpret_cast<const T*>(srcp);
+    // errors are kept in 1/16 units, shifted by one for the left neighbour.
+    T1* errc = reinterpret_cast<T1*>(err0) + 1;
+    T1* errn = reinterpret_cast<T1*>(err1) + 1;
+    std::fill_n(errn - 1, width + 2, static_cast<T1>(0));
+
+    for (int x = 0; x < width; ++x)
+    {
+        int q;
+        T1 e;
+        // the target is clamped first so that clipped pixels do not accumulate error.
+        if constexpr (std::is_integral_v<T>)
+        {
+            const int v = clamp(src[x] + ((errc[x] + 8) >> 4), 0, ((op->peak + 1) << op->shift) - 1);
+            q = min((v + op->ioffs[0][0]) >> op->shift, op->peak);
+            e = v - (q << op->shift);
+        }
+        else
+        {
+            const float v = clamp(src[x] * op->scale + op->foffs[0][0] - 0.5f + errc[x] * 0.0625f, 0.0f, static_cast<float>(op->peak));
+            q = static_cast<int>(v + 0.5f);
+            e = v - q;
+        }
+        errc[x + 1] += e * 7;
+        errn[x - 1] += e * 3;
+        errn[x] += e * 5;
+        errn[x + 1] += e;
+
+        if (op->peak > 255)
+            reinterpret_cast<uint16_t*>(dstp)[x] = static_cast<uint16_t>(q);
+        else
+            dstp[x] = static_cast<uint8_t>(q);
+    }
+}
+
+// Flicker energy of the current frame: the mean of min(|cur - prev|, |cur - next|) over every 4th pixel of every 8th row.
+// It is low on stable pictures, and also on scene changes and on pans that match one of the neighbours.
+template <typename T>
+static double flicker_energy(const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, int cpitch, int ppitch, int npitch, int width, int height) noexcept
+{
+    using T1 = std::conditional_t<std::is_integral_v<T>, int, float>;
+
+    double sum = 0.0;
+    int count = 0;
+    for (int y = 0; y < height; y += 8)
+    {
+        const T* cur = reinterpret_cast<const T*>(currp + static_cast<size_t>(cpitch) * y);
+        const T* prv = reinterpret_cast<const T*>(prevp + static_cast<size_t>(ppitch) * y);
+        const T* nxt = reinterpret_cast<const T*>(nextp + static_cast<size_t>(npitch) * y);
+        T1 row = 0;
+        for (int x = 0; x < width; x += 4)
+        {
+            const T1 c = static_cast<T1>(cur[x]);
+            row += min(absdiff(c, static_cast<T1>(prv[x])), absdiff(c, static_cast<T1>(nxt[x])));
+        }
+        sum += row;
+        count += (width + 3) / 4;
+    }
+    return count ? sum / count : 0.0;
+}
+
+// mask: the planes are processed by tiles of TILE_WIDTH x TILE_HEIGHT pixels.
+constexpr int TILE_WIDTH = 128;
+constexpr int TILE_HEIGHT = 16;
+
+// Coverage of a tile of the mask: 0 (empty), 1 (partial) or 2 (full).
+// The samples are compared with 0 and with the peak 8 bytes at a time.
+template <typename T>
+static int tile_coverage(const uint8_t* maskp, int mpitch, int width, int height, double peak) noexcept
+{
+    const T pk = static_cast<T>(peak);
+    uint64_t full = 0;
+    for (size_t i = 0; i < 8 / sizeof(T); ++i)
+        std::memcpy(reinterpret_cast<uint8_t*>(&full) + i * sizeof(T), &pk, sizeof(T));
+    const uint64_t one = full >> (64 - sizeof(T) * 8);
+    const int bytes = width * static_cast<int>(sizeof(T));
+
+    uint64_t any = 0, notfull = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t* m = maskp + static_cast<size_t>(mpitch) * y;
+        int x = 0;
+        for (; x + 8 <= bytes; x += 8)
+        {
+            uint64_t w;
+            std::memcpy(&w, m + x, 8);
+            any |= w;
+            notfull |= w ^ full;
+        }
+        for (; x < bytes; x += sizeof(T))
+        {
+            uint64_t w = 0;
+            std::memcpy(&w, m + x, sizeof(T));
+            any |= w;
+            notfull |= w ^ one;
+        }
+        if (any && notfull)
+            return 1;
+    }
+    return !any ? 0 : !notfull ? 2 : 1;
+}
+
+// dst = cur + (flt - cur) * mask / peak
+template <typename T>
+static void blend(uint8_t* dstp, const uint8_t* currp, const uint8_t* fltp, const uint8_t* maskp, int dpitch, int cpitch, int fpitch, int mpitch, int width, int height, double peak) noexcept
+{
+    for (int y = 0; y < height; ++y)
+    {
+        T* dst = reinterpret_cast<T*>(dstp + static_cast<size_t>(dpitch) * y);
+        const T* cur = reinterpret_cast<const T*>(currp + static_cast<size_t>(cpitch) * y);
+        const T* flt = reinterpret_cast<const T*>(fltp + static_cast<size_t>(fpitch) * y);
+        const T* msk = reinterpret_cast<const T*>(maskp + static_cast<size_t>(mpitch) * y);
+        for (int x = 0; x < width; ++x)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                const uint32_t pk = static_cast<uint32_t>(peak);
+                const uint32_t m = min(static_cast<uint32_t>(msk[x]), pk);
+                dst[x] = static_cast<T>((cur[x] * (pk - m) + flt[x] * m + pk / 2) / pk);
+            }
+            else
+            {
+                dst[x] = cur[x] + (flt[x] - cur[x]) * clamp(msk[x], 0.0f, 1.0f);
+            }
+        }
+    }
+}
+
+// spatial: the filtered rows go by strips of SPATIAL_ROWS through a small buffer.
+constexpr int SPATIAL_ROWS = 16;
+
+template <typename T>
+static F_INLINE void sort_pair(T& a, T& b)
+{
+    const T t = min(a, b);
+    b = max(a, b);
+    a = t;
+}
+
+// The center clipped to the MODE-th smallest and largest of its 8 neighbours (RemoveGrain modes 1..4):
+// min/max for mode 1, a sorting network of 19 pairs otherwise.
+template <int MODE, typename T>
+static F_INLINE T spatial_clip(T c, T* a)
+{
+    if constexpr (MODE == 1)
+    {
+        const T lo = min(min(min(a[0], a[1]), min(a[2], a[3])), min(min(a[4], a[5]), min(a[6], a[7])));
+        const T hi = max(max(max(a[0], a[1]), max(a[2], a[3])), max(max(a[4], a[5]), max(a[6], a[7])));
+        return clamp(c, lo, hi);
+    }
+    else
+    {
+        sort_pair(a[0], a[1]); sort_pair(a[2], a[3]); sort_pair(a[4], a[5]); sort_pair(a[6], a[7]);
+        sort_pair(a[0], a[2]); sort_pair(a[1], a[3]); sort_pair(a[4], a[6]); sort_pair(a[5], a[7]);
+        sort_pair(a[1], a[2]); sort_pair(a[5], a[6]);
+        sort_pair(a[0], a[4]); sort_pair(a[1], a[5]); sort_pair(a[2], a[6]); sort_pair(a[3], a[7]);
+        sort_pair(a[2], a[4]); sort_pair(a[3], a[5]);
+        sort_pair(a[1], a[2]); sort_pair(a[3], a[4]); sort_pair(a[5], a[6]);
+        return clamp(c, a[MODE - 1], a[8 - MODE]);
+    }
+}
+
+// 3x3 clean-up of the filtered rows: the rows above and below srcp are read, the first and the last columns are kept.
+template <typename T, int MODE>
+static void spatial_c(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    for (int y = 0; y < height; ++y)
+    {
+        T* dst = reinterpret_cast<T*>(dstp + static_cast<size_t>(dstride) * y);
+        const uint8_t* row = srcp + static_cast<ptrdiff_t>(sstride) * y;
+        const T* s0 = reinterpret_cast<const T*>(row - sstride);
+        const T* s1 = reinterpret_cast<const T*>(row);
+        const T* s2 = reinterpret_cast<const T*>(row + sstride);
+
+        dst[0] = s1[0];
+        for (int x = 1; x < width - 1; ++x)
+        {
+            T a[8] = { s0[x - 1], s0[x], s0[x + 1], s1[x - 1], s1[x + 1], s2[x - 1], s2[x], s2[x + 1] };
+            dst[x] = spatial_clip<MODE>(s1[x], a);
+        }
+        dst[width - 1] = s1[width - 1];
+    }
+}
+
+// Size of the last level cache, 0 when it is unknown.
+static size_t get_llc_size()
+{
+#ifdef _WIN32
+    DWORD len = 0;
+    GetLogicalProcessorInformation(nullptr, &len);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (info.empty() || !GetLogicalProcessorInformation(info.data(), &len))
+        return 0;
+
+    size_t size = 0;
+    for (const auto& i : info)
+        if (i.Relationship == RelationCache && i.Cache.Type != CacheInstruction)
+            size = max(size, static_cast<size_t>(i.Cache.Size));
+    return size;
+#elif defined(_SC_LEVEL3_CACHE_SIZE)
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? static_cast<size_t>(size) : 0;
+#else
+    return 0;
+#endif
+}
+
+// Flush-to-zero and denormals-are-zero (MXCSR) while the float routines run: denormal samples
+// (near black HDR) would otherwise take a microcode assist per operation. The previous state is restored.
+// AArch64: flush-to-zero (FPCR.FZ), elsewhere the state isn't changed.
+class DenormalGuard
+{
+    uint64_t csr;
+    bool active;
+
+    static uint64_t get_state()
+    {
+#if REDUCEFLICKER_X86
+        return _mm_getcsr();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        return fpcr;
+#else
+        return 0;
+#endif
+    }
+
+    static void set_state(uint64_t state)
+    {
+#if REDUCEFLICKER_X86
+        _mm_setcsr(static_cast<unsigned>(state));
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(state));
+#else
+        static_cast<void>(state);
+#endif
+    }
+
+public:
+    explicit DenormalGuard(bool enable) : csr(enable ? get_state() : 0), active(enable)
+    {
+#if REDUCEFLICKER_X86
+        if (active)
+            set_state(csr | 0x8040);
+#elif defined(__aarch64__)
+        if (active)
+            set_state(csr | (1u << 24));
+#endif
+    }
+    ~DenormalGuard()
+    {
+        if (active)
+            set_state(csr);
+    }
+    DenormalGuard(const DenormalGuard&) = delete;
+    DenormalGuard& operator=(const DenormalGuard&) = delete;
+};
+
+// Kernel table: kernel_table<T, STORE>[isa (0: C, 1: SSE2, 2: AVX2)][aggressive][strength - 1].
+// int16_t is 9..15-bit in 16-bit samples, which only SSE2 handles differently from uint16_t (signed min/max, signed saturating add).
+template <typename T, int STORE, int ISA, bool AGGRESSIVE, int STRENGTH>
+static constexpr kernel_t select_kernel()
+{
+    if constexpr (!REDUCEFLICKER_X86 && ISA != 0)
+        return select_kernel<T, STORE, 0, AGGRESSIVE, STRENGTH>();
+    else if constexpr (std::is_same_v<T, int16_t> && ISA != 1)
+        return select_kernel<uint16_t, STORE, ISA, AGGRESSIVE, STRENGTH>();
+    else if constexpr (ISA == 2)
+    {
+        if constexpr (STRENGTH > 3)
+            return AGGRESSIVE ? proc_ra_avx2<T, STORE> : proc_r_avx2<T, STORE>;
+        else
+            return AGGRESSIVE ? proc_a_avx2<T, STRENGTH, STORE> : proc_avx2<T, STRENGTH, STORE>;
+    }
+    else if constexpr (ISA == 1)
+    {
+        if constexpr (STRENGTH > 3)
+            return AGGRESSIVE ? proc_ra_sse2<T, STORE> : proc_r_sse2<T, STORE>;
+        else
+            return AGGRESSIVE ? proc_a_sse2<T, STRENGTH, STORE> : proc_sse2<T, STRENGTH, STORE>;
+    }
+    else
+    {
+        if constexpr (STRENGTH > 3)
+            return AGGRESSIVE ? proc_ra_c<T, STORE> : proc_r_c<T, STORE>;
+        else
+            return AGGRESSIVE ? proc_a_c<T, STRENGTH, STORE> : proc_c<T, STRENGTH, STORE>;
+    }
+}
+
+template <typename T, int STORE, int ISA, bool AGGRESSIVE, int... S>
+static constexpr std::array<kernel_t, MAX_STRENGTH> make_kernels(std::integer_sequence<int, S...>)
+{
+    return { { select_kernel<T, STORE, ISA, AGGRESSIVE, S + 1>()... } };
+}
+
+template <typename T, int STORE, int ISA>
+static constexpr std::array<std::array<kernel_t, MAX_STRENGTH>, 2> make_kernels()
+{
+    return { {
+        make_kernels<T, STORE, ISA, false>(std::make_integer_sequence<int, MAX_STRENGTH>()),
+        make_kernels<T, STORE, ISA, true>(std::make_integer_sequence<int, MAX_STRENGTH>()),
+    } };
+}
+
+template <typename T, int STORE>
+static constexpr std::array<std::array<std::array<kernel_t, MAX_STRENGTH>, 2>, 3> kernel_table = { {
+    make_kernels<T, STORE, 0>(),
+    make_kernels<T, STORE, 1>(),
+    make_kernels<T, STORE, 2>(),
+} };
+
+template <typename T, int STORE>
+static kernel_t get_kernel(int isa, bool aggressive, int strength)
+{
+    return kernel_table<T, STORE>[isa][aggressive][strength - 1];
+}
+
+template <typename T>
+static kernel_t get_kernel(int isa, bool aggressive, int strength, int store)
+{
+    switch (store)
+    {
+        case STORE_CACHED: return get_kernel<T, STORE_CACHED>(isa, aggressive, strength);
+        case STORE_STREAM | STORE_STATS: return get_kernel<T, STORE_STREAM | STORE_STATS>(isa, aggressive, strength);
+        case STORE_CACHED | STORE_STATS: return get_kernel<T, STORE_CACHED | STORE_STATS>(isa, aggressive, strength);
+        case STORE_STREAM | STORE_BOUND: return get_kernel<T, STORE_STREAM | STORE_BOUND>(isa, aggressive, strength);
+        case STORE_CACHED | STORE_BOUND: return get_kernel<T, STORE_CACHED | STORE_BOUND>(isa, aggressive, strength);
+        case STORE_STREAM | STORE_STATS | STORE_BOUND: return get_kernel<T, STORE_STREAM | STORE_STATS | STORE_BOUND>(isa, aggressive, strength);
+        case STORE_CACHED | STORE_STATS | STORE_BOUND: return get_kernel<T, STORE_CACHED | STORE_STATS | STORE_BOUND>(isa, aggressive, strength);
+    }
+    // 8-bit input is never converted.
+    if constexpr (!std::is_same_v<T, uint8_t>)
+    {
+        switch (store)
+        {
+            case STORE_TO8: return get_kernel<T, STORE_TO8>(isa, aggressive, strength);
+            case STORE_TO16: return get_kernel<T, STORE_TO16>(isa, aggressive, strength);
+            case STORE_TO8 | STORE_STATS: return get_kernel<T, STORE_TO8 | STORE_STATS>(isa, aggressive, strength);
+            case STORE_TO16 | STORE_STATS: return get_kernel<T, STORE_TO16 | STORE_STATS>(isa, aggressive, strength);
+        }
+    }
+    return get_kernel<T, STORE_STREAM>(isa, aggressive, strength);
+}
+
+template <typename T, int STORE>
+static fast_kernel_t get_fast_kernel(int isa, bool aggressive)
+{
+    if constexpr (!REDUCEFLICKER_X86)
+        return aggressive ? proc_f_c<T, true, STORE> : proc_f_c<T, false, STORE>;
+    else if constexpr (std::is_same_v<T, int16_t>)
+    {
+        if (isa == 1)
+            return aggressive ? proc_f_sse2<T, true, STORE> : proc_f_sse2<T, false, STORE>;
+        else
+            return get_fast_kernel<uint16_t, STORE>(isa, aggressive);
+    }
+    else if (isa == 2)
+        return aggressive ? proc_f_avx2<T, true, STORE> : proc_f_avx2<T, false, STORE>;
+    else if (isa == 1)
+        return aggressive ? proc_f_sse2<T, true, STORE> : proc_f_sse2<T, false, STORE>;
+    else
+        return aggressive ? proc_f_c<T, true, STORE> : proc_f_c<T, false, STORE>;
+}
+
+template <typename T>
+static fast_kernel_t get_fast_kernel(int isa, bool aggressive, int store)
+{
+    switch (store)
+    {
+        case STORE_CACHED: return get_fast_kernel<T, STORE_CACHED>(isa, aggressive);
+        case STORE_STREAM | STORE_STATS: return get_fast_kernel<T, STORE_STREAM | STORE_STATS>(isa, aggressive);
+        case STORE_CACHED | STORE_STATS: return get_fast_kernel<T, STORE_CACHED | STORE_STATS>(isa, aggressive);
+        case STORE_STREAM | STORE_BOUND: return get_fast_kernel<T, STORE_STREAM | STORE_BOUND>(isa, aggressive);
+        case STORE_CACHED | STORE_BOUND: return get_fast_kernel<T, STORE_CACHED | STORE_BOUND>(isa, aggressive);
+        case STORE_STREAM | STORE_STATS | STORE_BOUND: return get_fast_kernel<T, STORE_STREAM | STORE_STATS | STORE_BOUND>(isa, aggressive);
+        case STORE_CACHED | STORE_STATS | STORE_BOUND: return get_fast_kernel<T, STORE_CACHED | STORE_STATS | STORE_BOUND>(isa, aggressive);
+    }
+    if constexpr (!std::is_same_v<T, uint8_t>)
+    {
+        switch (store)
+        {
+            case STORE_TO8: return get_fast_kernel<T, STORE_TO8>(isa, aggressive);
+            case STORE_TO16: return get_fast_kernel<T, STORE_TO16>(isa, aggressive);
+            case STORE_TO8 | STORE_STATS: return get_fast_kernel<T, STORE_TO8 | STORE_STATS>(isa, aggressive);
+            case STORE_TO16 | STORE_STATS: return get_fast_kernel<T, STORE_TO16 | STORE_STATS>(isa, aggressive);
+        }
+    }
+    return get_fast_kernel<T, STORE_STREAM>(isa, aggressive);
+}
+
+// causal: one routine per instruction set, the strength is read at run time.
+template <typename T, int STORE>
+static kernel_t get_causal_kernel(int isa, bool aggressive)
+{
+    if constexpr (!REDUCEFLICKER_X86)
+        return aggressive ? proc_p_c<T, true, STORE> : proc_p_c<T, false, STORE>;
+    else if constexpr (std::is_same_v<T, int16_t>)
+    {
+        if (isa == 1)
+            return aggressive ? proc_p_sse2<T, true, STORE> : proc_p_sse2<T, false, STORE>;
+        else
+            return get_causal_kernel<uint16_t, STORE>(isa, aggressive);
+    }
+    else if (isa == 2)
+        return aggressive ? proc_p_avx2<T, true, STORE> : proc_p_avx2<T, false, STORE>;
+    else if (isa == 1)
+        return aggressive ? proc_p_sse2<T, true, STORE> : proc_p_sse2<T, false, STORE>;
+    else
+        return aggressive ? proc_p_c<T, true, STORE> : proc_p_c<T, false, STORE>;
+}
+
+template <typename T>
+static kernel_t get_causal_kernel(int isa, bool aggressive, int store)
+{
+    switch (store)
+    {
+        case STORE_CACHED: return get_causal_kernel<T, STORE_CACHED>(isa, aggressive);
+        case STORE_STREAM | STORE_STATS: return get_causal_kernel<T, STORE_STREAM | STORE_STATS>(isa, aggressive);
+        case STORE_CACHED | STORE_STATS: return get_causal_kernel<T, STORE_CACHED | STORE_STATS>(isa, aggressive);
+        case STORE_STREAM | STORE_BOUND: return get_causal_kernel<T, STORE_STREAM | STORE_BOUND>(isa, aggressive);
+        case STORE_CACHED | STORE_BOUND: return get_causal_kernel<T, STORE_CACHED | STORE_BOUND>(isa, aggressive);
+        case STORE_STREAM | STORE_STATS | STORE_BOUND: return get_causal_kernel<T, STORE_STREAM | STORE_STATS | STORE_BOUND>(isa, aggressive);
+        case STORE_CACHED | STORE_STATS | STORE_BOUND: return get_causal_kernel<T, STORE_CACHED | STORE_STATS | STORE_BOUND>(isa, aggressive);
+    }
+    if constexpr (!std::is_same_v<T, uint8_t>)
+    {
+        switch (store)
+        {
+            case STORE_TO8: return get_causal_kernel<T, STORE_TO8>(isa, aggressive);
+            case STORE_TO16: return get_causal_kernel<T, STORE_TO16>(isa, aggressive);
+            case STORE_TO8 | STORE_STATS: return get_causal_kernel<T, STORE_TO8 | STORE_STATS>(isa, aggressive);
+            case STORE_TO16 | STORE_STATS: return get_causal_kernel<T, STORE_TO16 | STORE_STATS>(isa, aggressive);
+        }
+    }
+    return get_causal_kernel<T, STORE_STREAM>(isa, aggressive);
+}
+
+// spatial: RemoveGrain modes 1..4 (0: none).
+template <typename T, int MODE>
+static spatial_t get_spatial_kernel(int isa)
+{
+    if constexpr (!REDUCEFLICKER_X86)
+        return spatial_c<T, MODE>;
+    else
+        return isa == 2 ? spatial_avx2<T, MODE> : isa == 1 ? spatial_sse2<T, MODE> : spatial_c<T, MODE>;
+}
+
+template <typename T>
+static spatial_t get_spatial_kernel(int isa, int mode)
+{
+    switch (mode)
+    {
+        case 1: return get_spatial_kernel<T, 1>(isa);
+        case 2: return get_spatial_kernel<T, 2>(isa);
+        case 3: return get_spatial_kernel<T, 3>(isa);
+        case 4: return get_spatial_kernel<T, 4>(isa);
+    }
+    return nullptr;
+}
+
+// variants: one routine per instruction set, the strengths and modes are read at run time.
+template <typename T, int STORE>
+static multi_kernel_t get_multi_kernel(int isa)
+{
+    if constexpr (!REDUCEFLICKER_X86)
+        return proc_v_c<T, STORE>;
+    else if constexpr (std::is_same_v<T, int16_t>)
+        return isa == 1 ? proc_v_sse2<T, STORE> : get_multi_kernel<uint16_t, STORE>(isa);
+    else
+        return isa == 2 ? proc_v_avx2<T, STORE> : isa == 1 ? proc_v_sse2<T, STORE> : proc_v_c<T, STORE>;
+}
+
+template <typename T>
+static multi_kernel_t get_multi_kernel(int isa, int store)
+{
+    return store == STORE_CACHED ? get_multi_kernel<T, STORE_CACHED>(isa) : get_multi_kernel<T, STORE_STREAM>(isa);
+}
+
+// f16: float only, AVX2 with F16C.
+template <int STORE>
+static kernel_t get_f16_kernel(bool aggressive)
+{
+    if constexpr (!REDUCEFLICKER_X86)
+        return nullptr;
+    else
+        return aggressive ? proc_h_avx2<true, STORE> : proc_h_avx2<false, STORE>;
+}
+
+static kernel_t get_f16_kernel(bool aggressive, int store)
+{
+    switch (store)
+    {
+        case STORE_CACHED: return get_f16_kernel<STORE_CACHED>(aggressive);
+        case STORE_TO8: return get_f16_kernel<STORE_TO8>(aggressive);
+        case STORE_TO16: return get_f16_kernel<STORE_TO16>(aggressive);
+        case STORE_STREAM | STORE_STATS: return get_f16_kernel<STORE_STREAM | STORE_STATS>(aggressive);
+        case STORE_CACHED | STORE_STATS: return get_f16_kernel<STORE_CACHED | STORE_STATS>(aggressive);
+        case STORE_TO8 | STORE_STATS: return get_f16_kernel<STORE_TO8 | STORE_STATS>(aggressive);
+        case STORE_TO16 | STORE_STATS: return get_f16_kernel<STORE_TO16 | STORE_STATS>(aggressive);
+        case STORE_STREAM | STORE_BOUND: return get_f16_kernel<STORE_STREAM | STORE_BOUND>(aggressive);
+        case STORE_CACHED | STORE_BOUND: return get_f16_kernel<STORE_CACHED | STORE_BOUND>(aggressive);
+        case STORE_STREAM | STORE_STATS | STORE_BOUND: return get_f16_kernel<STORE_STREAM | STORE_STATS | STORE_BOUND>(aggressive);
+        case STORE_CACHED | STORE_STATS | STORE_BOUND: return get_f16_kernel<STORE_CACHED | STORE_STATS | STORE_BOUND>(aggressive);
+    }
+    return get_f16_kernel<STORE_STREAM>(aggressive);
+}
+
+template <typename T>
+static decimate_t get_decimate(int isa)
+{
+    if constexpr (!REDUCEFLICKER_X86)
+        return decimate_c<T>;
+    else
+        return isa == 2 ? decimate_avx2<T> : isa == 1 ? decimate_sse2<T> : decimate_c<T>;
+}
+
+// Source frames for the f16 routines.
+static decimate_t get_f16_decimate()
+{
+#if REDUCEFLICKER_X86
+    return to_f16_avx2;
+#else
+    return nullptr;
+#endif
+}
+
+ReduceFlicker::ReduceFlicker(PClip c, const ReduceFlickerParams& p, IScriptEnvironment* env) :
+    GenericVideoFilter(c), _grey(p.grey), opt_(p.opt), raccess(p.raccess), _luma(p.luma), inplace(p.inplace), fast(p.fast), causal(p.causal), spatial(p.spatial), bound(p.bound), nvariants(p.nvariants), budget(p.budget / 1000.0), stats(p.stats), skip(p.skip), weak(p.weak), mask(p.mask), dither(p.dither), first(p.first), afirst(p.afirst), alast(p.alast)
+{
+    has_at_least_v8 = true;
+    try { env->CheckVersion(8); }
+    catch (const AvisynthError&) { has_at_least_v8 = false; }
+
+    for (int v = 0; v < nvariants; ++v)
+        variants[v] = p.variants[v];
+
+    mask_last = mask ? mask->GetVideoInfo().num_frames - 1 : 0;
+
+    bool planeAggressive[3];
+    int planecount = min(vi.NumComponents(), 3);
+    for (int i = 0; i < planecount; ++i)
+    {
+        if (vi.IsRGB())
+            processPlane[i] = true;
+        else if (i == 0)
+            processPlane[i] = _luma;
+        else
+            processPlane[i] = !_grey;
+
+        const bool chroma = !vi.IsRGB() && i > 0;
+        planeStrength[i] = chroma ? p.cstrength : p.strength;
+        planeAggressive[i] = chroma ? p.caggressive : p.aggressive;
+    }
+
+    // the frames are fetched for the widest window of the processed planes.
+    strength = 1;
+    for (int i = 0; i < planecount; ++i)
+        if (processPlane[i])
+            strength = max(strength, planeStrength[i]);
+    qos.reset(strength, budget);
+
+    // the AVX2 float routines use FMA3.
+    avx2 = REDUCEFLICKER_X86 && ((!!(env->GetCPUFlags() & CPUF_AVX2) && (vi.ComponentSize() != 4 || !!(env->GetCPUFlags() & CPUF_FMA3)) && opt_ < 0) || opt_ == 2);
+    sse2 = REDUCEFLICKER_X86 && ((!!(env->GetCPUFlags() & CPUF_SSE2) && opt_ < 0) || opt_ == 1);
+
+    align = avx2 ? 32 : 16;
+    // only the AVX2 routine has the f16 variant. Below strength 4 the half copies cost more than the reads they save.
+    f16 = p.f16 && avx2 && !!(env->GetCPUFlags() & CPUF_F16C) && strength >= F16_MIN_STRENGTH;
+
+    // Segment: only first..last are output, and the neighbours are clamped to afirst..alast
+    // (the whole title), so that the seams between segments match a monolithic run.
+    if (first != 0 || p.last != vi.num_frames - 1)
+    {
+        vi.num_frames = p.last - first + 1;
+        vi.audio_samples_per_second = 0;
+        vi.num_audio_samples = 0;
+    }
+
+    // strength 1 still uses n - 2 for the bound.
+    nprev = max(strength, 2);
+    in_size = vi.ComponentSize();
+    const int in_bits = vi.BitsPerComponent();
+    in_peak = in_size == 4 ? 1.0 : (1 << in_bits) - 1.0;
+    int store = STORE_STREAM;
+    converting = p.bits != in_bits;
+
+    if (converting)
+    {
+        static constexpr uint8_t bayer[8][8] = {
+            {  0, 32,  8, 40,  2, 34, 10, 42 },
+            { 48, 16, 56, 24, 50, 18, 58, 26 },
+            { 12, 44,  4, 36, 14, 46,  6, 38 },
+            { 60, 28, 52, 20, 62, 30, 54, 22 },
+            {  3, 35, 11, 43,  1, 33,  9, 41 },
+            { 51, 19, 59, 27, 49, 17, 57, 25 },
+            { 15, 47,  7, 39, 13, 45,  5, 37 },
+            { 63, 31, 55, 23, 61, 29, 53, 21 },
+        };
+
+        // error diffusion rounds each pixel and carries the remainder itself.
+        const bool ordered = dither == 0;
+
+        for (int i = 0; i < planecount; ++i)
+        {
+            OutputParams& op = oparams[i];
+            op.shift = in_size == 4 ? 0 : vi.BitsPerComponent() - p.bits;
+            op.peak = (1 << p.bits) - 1;
+            op.scale = static_cast<float>(op.peak);
+            const float offset = (!vi.IsRGB() && i > 0) ? static_cast<float>(1 << (p.bits - 1)) : 0.0f;
+            for (int y = 0; y < 8; ++y)
+                for (int x = 0; x < 16; ++x)
+                {
+                    const int d = ordered ? bayer[y][x & 7] * 2 + 1 : 64;
+                    op.ioffs[y][x] = static_cast<int16_t>((d << op.shift) >> 7);
+                    if (x < 8)
+                        op.foffs[y][x] = offset + d / 128.0f;
+                }
+        }
+
+        store = p.bits == 8 ? STORE_TO8 : STORE_TO16;
+
+        const int sample_bits = p.bits == 8 ? VideoInfo::CS_Sample_Bits_8
+            : p.bits == 10 ? VideoInfo::CS_Sample_Bits_10
+            : p.bits == 12 ? VideoInfo::CS_Sample_Bits_12
+            : p.bits == 14 ? VideoInfo::CS_Sample_Bits_14
+            : VideoInfo::CS_Sample_Bits_16;
+        vi.pixel_type = (vi.pixel_type & ~VideoInfo::CS_Sample_Bits_Mask) | sample_bits;
+        inplace = false;
+    }
+    else
+    {
+        dither = -1;
+
+        // Non-temporal stores keep a large output from evicting the frames that are still to be read,
+        // regular stores leave a small one in the cache for the next filter of the script.
+        int store_policy = p.store;
+        if (store_policy < 0)
+        {
+            size_t frame_size = 0;
+            for (int i = 0; i < planecount; ++i)
+            {
+                if (!processPlane[i])
+                    continue;
+                const int plane = !vi.IsRGB() && i > 0 ? PLANAR_U : PLANAR_Y;
+                frame_size += static_cast<size_t>(vi.width >> vi.GetPlaneWidthSubsampling(plane)) * (vi.height >> vi.GetPlaneHeightSubsampling(plane)) * in_size;
+            }
+            const size_t llc = get_llc_size();
+            store_policy = llc > 0 && frame_size * 2 <= llc;
+        }
+        if (store_policy == 1)
+            store = STORE_CACHED;
+    }
+
+    // the rows of the error diffusion and the partly masked tiles are stored in a small buffer.
+    int row_store = STORE_CACHED;
+    if (stats)
+    {
+        store |= STORE_STATS;
+        row_store |= STORE_STATS;
+    }
+    if (bound)
+    {
+        store |= STORE_BOUND;
+        row_store |= STORE_BOUND;
+    }
+
+    const int isa = avx2 ? 2 : sse2 ? 1 : 0;
+
+    for (int i = 0; i < planecount; ++i)
+    {
+        const int ps = planeStrength[i];
+        const bool pa = planeAggressive[i];
+
+        switch (in_size)
+        {
+            case 1:
+                process[i] = get_kernel<uint8_t>(isa, pa, ps, store);
+                process_weak[i] = get_kernel<uint8_t>(isa, pa, 1, store);
+                process_fast[i] = get_fast_kernel<uint8_t>(isa, pa, store);
+                // partly masked tiles are filtered into a small buffer.
+                process_row[i] = get_kernel<uint8_t>(isa, pa, ps, row_store);
+                process_weak_row[i] = get_kernel<uint8_t>(isa, pa, 1, row_store);
+                process_fast_row[i] = get_fast_kernel<uint8_t>(isa, pa, row_store);
+                break;
+            case 2:
+                if (in_bits < 16)
+                {
+                    process[i] = get_kernel<int16_t>(isa, pa, ps, store);
+                    process_row[i] = get_kernel<int16_t>(isa, pa, ps, row_store);
+                    process_weak[i] = get_kernel<int16_t>(isa, pa, 1, store);
+                    process_weak_row[i] = get_kernel<int16_t>(isa, pa, 1, row_store);
+                    process_fast[i] = get_fast_kernel<int16_t>(isa, pa, store);
+                    process_fast_row[i] = get_fast_kernel<int16_t>(isa, pa, row_store);
+                }
+                else
+                {
+                    process[i] = get_kernel<uint16_t>(isa, pa, ps, store);
+                    process_row[i] = get_kernel<uint16_t>(isa, pa, ps, row_store);
+                    process_weak[i] = get_kernel<uint16_t>(isa, pa, 1, store);
+                    process_weak_row[i] = get_kernel<uint16_t>(isa, pa, 1, row_store);
+                    process_fast[i] = get_fast_kernel<uint16_t>(isa, pa, store);
+                    process_fast_row[i] = get_fast_kernel<uint16_t>(isa, pa, row_store);
+                }
+                break;
+            default:
+                process[i] = f16 ? get_f16_kernel(pa, store) : get_kernel<float>(isa, pa, ps, store);
+                process_row[i] = f16 ? get_f16_kernel(pa, row_store) : get_kernel<float>(isa, pa, ps, row_store);
+                process_weak[i] = f16 ? process[i] : get_kernel<float>(isa, pa, 1, store);
+                process_weak_row[i] = f16 ? process_row[i] : get_kernel<float>(isa, pa, 1, row_store);
+                process_fast[i] = get_fast_kernel<float>(isa, pa, store);
+                process_fast_row[i] = get_fast_kernel<float>(isa, pa, row_store);
+                break;
+        }
+
+        // causal: the routines read only the previous frames, strength 1 (weak) is the same routine.
+        // fast and f16 keep their routines, with the previous frames in place of the next ones.
+        if (causal && !f16)
+        {
+            switch (in_size)
+            {
+                case 1:
+                    process[i] = get_causal_kernel<uint8_t>(isa, pa, store);
+                    process_row[i] = get_causal_kernel<uint8_t>(isa, pa, row_store);
+                    break;
+                case 2:
+                    process[i] = in_bits < 16 ? get_causal_kernel<int16_t>(isa, pa, store) : get_causal_kernel<uint16_t>(isa, pa, store);
+                    process_row[i] = in_bits < 16 ? get_causal_kernel<int16_t>(isa, pa, row_store) : get_causal_kernel<uint16_t>(isa, pa, row_store);
+                    break;
+                default:
+                    process[i] = get_causal_kernel<float>(isa, pa, store);
+                    process_row[i] = get_causal_kernel<float>(isa, pa, row_store);
+                    break;
+            }
+            process_weak[i] = process[i];
+            process_weak_row[i] = process_row[i];
+        }
+
+        // budget: the routines of the levels below the strength of the plane (causal and f16 read the strength at run time).
+        for (int k = 2; budget > 0.0 && k < ps; ++k)
+        {
+            if (causal || f16)
+            {
+                process_level[i][k - 1] = process[i];
+                process_level_row[i][k - 1] = process_row[i];
+                continue;
+            }
+            switch (in_size)
+            {
+                case 1:
+                    process_level[i][k - 1] = get_kernel<uint8_t>(isa, pa, k, store);
+                    process_level_row[i][k - 1] = get_kernel<uint8_t>(isa, pa, k, row_store);
+                    break;
+                case 2:
+                    process_level[i][k - 1] = in_bits < 16 ? get_kernel<int16_t>(isa, pa, k, store) : get_kernel<uint16_t>(isa, pa, k, store);
+                    process_level_row[i][k - 1] = in_bits < 16 ? get_kernel<int16_t>(isa, pa, k, row_store) : get_kernel<uint16_t>(isa, pa, k, row_store);
+                    break;
+                default:
+                    process_level[i][k - 1] = get_kernel<float>(isa, pa, k, store);
+                    process_level_row[i][k - 1] = get_kernel<float>(isa, pa, k, row_store);
+                    break;
+            }
+        }
+
+        switch (in_size)
+        {
+            case 1: process_spatial[i] = get_spatial_kernel<uint8_t>(isa, spatial); break;
+            case 2: process_spatial[i] = get_spatial_kernel<uint16_t>(isa, spatial); break;
+            default: process_spatial[i] = get_spatial_kernel<float>(isa, spatial); break;
+        }
+
+        switch (in_size)
+        {
+            case 1: process_multi[i] = get_multi_kernel<uint8_t>(isa, store); break;
+            case 2: process_multi[i] = in_bits < 16 ? get_multi_kernel<int16_t>(isa, store) : get_multi_kernel<uint16_t>(isa, store); break;
+            default: process_multi[i] = get_multi_kernel<float>(isa, store); break;
+        }
+    }
+
+    if (f16)
+    {
+        decimate = get_f16_decimate();
+        half_cache.resize((nprev + strength + 1) * 2);
+    }
+    else if (fast)
+    {
+        switch (in_size)
+        {
+            case 1: decimate = get_decimate<uint8_t>(isa); break;
+            case 2: decimate = get_decimate<uint16_t>(isa); break;
+            default: decimate = get_decimate<float>(isa); break;
+        }
+
+        // enough source frames for the window of a few frames in flight.
+        half_cache.resize((nprev + strength + 1) * 2);
+    }
+
+    // The output frames being processed by different threads have most of their neighbours in common.
+    // Keeping the last source frames lets each of them be requested once, even when the cache of the host drops them.
+    // inplace needs the current frame to be held by nobody else.
+    int ring = p.ring;
+    if (ring < 0)
+        ring = (nprev + strength + 1) * 2;
+    if (ring > 0 && !inplace)
+        frame_ring.resize(ring);
+
+    // Multi-pass encodes: the output frames are kept in a file and served again when their source frames
+    // and the parameters are the same.
+    if (p.cache)
+    {
+        const int planes_y[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+        const int planes_r[3] = { PLANAR_G, PLANAR_B, PLANAR_R };
+        const int* current_planes = !vi.IsRGB() ? planes_y : planes_r;
+        size_t frame_size = 0;
+        for (int i = 0; i < planecount; ++i)
+        {
+            cache_offsets[i] = frame_size;
+            if (processPlane[i])
+                frame_size += static_cast<size_t>(vi.BytesFromPixels(vi.width >> vi.GetPlaneWidthSubsampling(current_planes[i]))) * (vi.height >> vi.GetPlaneHeightSubsampling(current_planes[i]));
+        }
+
+        // everything but the source frames that changes the output.
+        const int64_t params[] = {
+            1, vi.pixel_type, vi.width, vi.height, vi.num_frames, in_size, in_bits,
+            planeStrength[0], planeStrength[1], planeStrength[2], planeAggressive[0], planeAggressive[1], planeAggressive[2],
+            processPlane[0], processPlane[1], processPlane[2], fast, f16, causal, spatial, dither, isa, first, afirst, alast, !!mask,
+            static_cast<int64_t>(skip * 65536.0f), static_cast<int64_t>(weak * 65536.0f),
+        };
+        cache_params = hash_bytes(0, reinterpret_cast<const uint8_t*>(params), sizeof(params), sizeof(params), 1);
+
+        cache = std::make_unique<OutputCache>(p.cache, cache_params, vi.num_frames, frame_size);
+        if (!cache->is_open())
+            env->ThrowError("ReduceFlicker: can't map the cache file \"%s\".", p.cache);
+        hash_ring.resize((nprev + strength + 1) * 2);
+    }
+}
+
+PVideoFrame ReduceFlicker::get_frame(int n, IScriptEnvironment* env)
+{
+    if (frame_ring.empty())
+        return child->GetFrame(n, env);
+
+    PVideoFrame frame;
+    if (frame_ring.find(n, frame))
+        return frame;
+    return frame_ring.insert(n, child->GetFrame(n, env));
+}
+
+// Key of output frame n in the cache: the hashes of the source frames of its window (and of its mask), in order.
+uint64_t ReduceFlicker::get_key(int n, IScriptEnvironment* env)
+{
+    const int planes_y[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    const int planes_r[3] = { PLANAR_G, PLANAR_B, PLANAR_R };
+    const int* current_planes = !vi.IsRGB() ? planes_y : planes_r;
+    const int planecount = min(vi.NumComponents(), 3);
+
+    auto hash_frame = [&](uint64_t h, const PVideoFrame& frame)
+    {
+        for (int i = 0; i < planecount; ++i)
+            if (processPlane[i])
+            {
+                const int plane = current_planes[i];
+                h = hash_bytes(h, frame->GetReadPtr(plane), frame->GetPitch(plane), frame->GetRowSize(plane), frame->GetHeight(plane));
+            }
+        return h;
+    };
+
+    // each source frame is hashed once for all the windows it belongs to.
+    auto source_hash = [&](int k)
+    {
+        uint64_t h;
+        if (hash_ring.find(k, h))
+            return h;
+        return hash_ring.insert(k, hash_frame(k, get_frame(k, env)));
+    };
+
+    uint64_t window[MAX_STRENGTH * 2 + 2];
+    int count = 0;
+    for (int k = nprev; k > 0; --k)
+        window[count++] = source_hash(max(n - k, afirst));
+    window[count++] = source_hash(n);
+    for (int k = 1; k <= (causal ? 0 : strength); ++k)
+        window[count++] = source_hash(min(n + k, alast));
+    if (mask)
+        window[count++] = hash_frame(0, mask->GetFrame(min(n, mask_last), env));
+
+    const uint64_t key = hash_bytes(cache_params, reinterpret_cast<const uint8_t*>(window), 0, sizeof(uint64_t) * count, 1);
+    // 0 is an empty slot.
+    return key ? key : 1;
+}
+
+// Each source frame is decimated (or converted to half floats) once and shared by all the output frames around it.
+std::shared_ptr<const HalfFrame> ReduceFlicker::get_half(int n, const PVideoFrame& src)
+{
+    std::shared_ptr<const HalfFrame> cached;
+    if (half_cache.find(n, cached))
+        return cached;
+
+    BufferPool* pool = &half_pool;
+    std::shared_ptr<HalfFrame> half(new HalfFrame(), [pool](HalfFrame* h)
+    {
+        pool->put(std::move(h->buff));
+        delete h;
+    });
+    int planes_y[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+    int planes_r[3] = { PLANAR_G, PLANAR_B, PLANAR_R };
+    const int* current_planes = !vi.IsRGB() ? planes_y : planes_r;
+    const int planecount = min(vi.NumComponents(), 3);
+
+    size_t offsets[3] = {};
+    size_t size = 0;
+    for (int i = 0; i < planecount; ++i)
+    {
+        const int width = src->GetRowSize(current_planes[i]) / in_size;
+        const int height = src->GetHeight(current_planes[i]);
+        half->width[i] = f16 ? width : (width + 1) / 2;
+        half->height[i] = f16 ? height : (height + 1) / 2;
+        // padded so that the simd kernels can read half a register past the end of a row.
+        half->pitch[i] = (half->width[i] * (f16 ? 2 : in_size) + 63) / 64 * 64 + 64;
+        offsets[i] = size;
+        if (processPlane[i])
+            size += static_cast<size_t>(half->pitch[i]) * half->height[i];
+    }
+
+    half->buff = half_pool.get(size + 64);
+    uint8_t* base = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(half->buff.get()) + 63) & ~static_cast<uintptr_t>(63));
+    for (int i = 0; i < planecount; ++i)
+    {
+        half->ptr[i] = base + offsets[i];
+        if (processPlane[i])
+        {
+            const int plane = current_planes[i];
+            decimate(half->ptr[i], src->GetReadPtr(plane), half->pitch[i], src->GetPitch(plane), src->GetRowSize(plane) / in_size, src->GetHeight(plane));
+        }
+    }
+
+    return half_cache.insert(n, half);
+}
+
+PVideoFrame __stdcall ReduceFlicker::GetFrame(int n, IScriptEnvironment* env)
+{
+    PVideoFrame curr, prev[MAX_STRENGTH], next[MAX_STRENGTH];
+    n = first + clamp(n, 0, vi.num_frames - 1);
+
+    int planes_y[4] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
+    int planes_r[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+    const int* current_planes = !vi.IsRGB() ? planes_y : planes_r;
+    int planecount = min(vi.NumComponents(), 3);
+
+    // cache: the output of a previous run made from the same source frames.
+    uint64_t key = 0;
+    if (cache)
+    {
+        key = get_key(n, env);
+        if (const uint8_t* slot = cache->find(n - first, key))
+        {
+            curr = get_frame(n, env);
+            PVideoFrame dst = has_at_least_v8 ? env->NewVideoFrameP(vi, &curr, align) : env->NewVideoFrame(vi, align);
+            for (int i = 0; i < planecount; ++i)
+                if (processPlane[i])
+                {
+                    const int plane = current_planes[i];
+                    env->BitBlt(dst->GetWritePtr(plane), dst->GetPitch(plane), slot + cache_offsets[i], dst->GetRowSize(plane), dst->GetRowSize(plane), dst->GetHeight(plane));
+                }
+            return dst;
+        }
+    }
+
+    // budget: the strength is capped by the level of the controller (0: pass-through), the time of the frame is measured from here.
+    const auto start = std::chrono::steady_clock::now();
+    const int level = budget > 0.0 ? qos.level() : strength;
+
+    // adaptive: the strength of the frame (0: pass-through) is chosen from n - 1, n and n + 1 (causal: n - 1 and n),
+    // then only the frames needed by that strength are requested.
+    int fstrength = level;
+    int fetched = 0;
+    if (skip > 0.0f || weak > 0.0f)
+    {
+        if (raccess)
+        {
+            if (!causal)
+                next[0] = get_frame(min(n + 1, alast), env);
+            curr = get_frame(n, env);
+            prev[0] = get_frame(max(n - 1, afirst), env);
+        }
+        else
+        {
+            prev[0] = get_frame(max(n - 1, afirst), env);
+            curr = get_frame(n, env);
+            if (!causal)
+                next[0] = get_frame(min(n + 1, alast), env);
+        }
+        if (causal)
+            next[0] = prev[0];
+        fetched = 1;
+
+        const int plane = vi.IsRGB() ? PLANAR_G : PLANAR_Y;
+        const uint8_t* currp = curr->GetReadPtr(plane);
+        const uint8_t* prevp = prev[0]->GetReadPtr(plane);
+        const uint8_t* nextp = next[0]->GetReadPtr(plane);
+        const int cpitch = curr->GetPitch(plane), ppitch = prev[0]->GetPitch(plane), npitch = next[0]->GetPitch(plane);
+        const int width = curr->GetRowSize(plane) / in_size;
+        const int height = curr->GetHeight(plane);
+        double energy;
+        switch (in_size)
+        {
+            case 1: energy = flicker_energy<uint8_t>(currp, prevp, nextp, cpitch, ppitch, npitch, width, height); break;
+            case 2: energy = flicker_energy<uint16_t>(currp, prevp, nextp, cpitch, ppitch, npitch, width, height); break;
+            default: energy = flicker_energy<float>(currp, prevp, nextp, cpitch, ppitch, npitch, width, height); break;
+        }
+        energy *= 255.0 / in_peak;
+
+        fstrength = energy < skip ? 0 : energy < weak ? min(level, 1) : level;
+        // nothing to convert, to clean up or to report.
+        if (fstrength == 0 && !converting && !spatial && !stats && !bound)
+            return budget > 0.0 ? pass_through(curr, level, start, env) : curr;
+    }
+
+    const int fprev = fstrength > 0 ? max(fstrength, 2) : 0;
+    // causal: nothing after n is requested, the next frames are the previous ones.
+    const int fnext = causal ? 0 : fstrength;
+    if (raccess)
+    {
+        for (int k = fnext; k > fetched; --k)
+            next[k - 1] = get_frame(min(n + k, alast), env);
+        if (fetched == 0)
+            curr = get_frame(n, env);
+        for (int k = fetched + 1; k <= fprev; ++k)
+            prev[k - 1] = get_frame(max(n - k, afirst), env);
+    }
+    else
+    {
+        for (int k = fprev; k > fetched; --k)
+            prev[k - 1] = get_frame(max(n - k, afirst), env);
+        if (fetched == 0)
+            curr = get_frame(n, env);
+        for (int k = fetched + 1; k <= fnext; ++k)
+            next[k - 1] = get_frame(min(n + k, alast), env);
+    }
+    if (causal)
+        for (int k = 0; k < fstrength; ++k)
+            next[k] = prev[k];
+
+    if (fstrength == 0 && budget > 0.0 && !converting && !spatial && !stats && !bound)
+        return pass_through(curr, level, start, env);
+
+    // pass-through with a conversion: strength 1 with the current frame as all the neighbours gives the current frame.
+    if (fstrength == 0)
+        prev[0] = prev[1] = next[0] = curr;
+    const int np = max(fstrength, 2);
+    const int nn = max(fstrength, 1);
+
+    PVideoFrame mframe;
+    std::vector<uint8_t> tbuff;
+    uint8_t* tilep = nullptr;
+    constexpr int tpitch = TILE_WIDTH * sizeof(float);
+    if (mask)
+    {
+        mframe = mask->GetFrame(min(n, mask_last), env);
+        tbuff.resize(static_cast<size_t>(tpitch) * TILE_HEIGHT + align);
+        tilep = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(tbuff.data()) + align - 1) & ~(align - 1));
+    }
+
+    // The kernels read cur[x] before writing dst[x], so the current frame can be the destination
+    // as long as nobody else holds it (it is not writable when it is also one of the neighbours).
+    PVideoFrame dst;
+    const bool reuse = inplace && curr->IsWritable();
+    if (reuse)
+        dst = curr;
+    else
+        dst = has_at_least_v8 ? env->NewVideoFrameP(vi, &curr, align) : env->NewVideoFrame(vi, align);
+    // whether the current frame could be reused: it is also held by the cache of the upstream filter in most graphs.
+    if (inplace && has_at_least_v8)
+        env->propSetInt(env->getFramePropsRW(dst), "ReduceFlickerInplace", reuse, 0);
+
+    // bound: the kernels write it next to the output, in a frame of the input format.
+    PVideoFrame bframe;
+    if (bound)
+        bframe = env->NewVideoFrame(vi, align);
+
+    // variants: the output is the first one, the frames of the others are attached to it.
+    PVideoFrame vframes[MAX_VARIANTS];
+    vframes[0] = dst;
+    for (int v = 1; v < nvariants; ++v)
+        vframes[v] = env->NewVideoFrameP(vi, &curr, align);
+
+    // all the frames are fetched: the float state of the upstream filters isn't changed.
+    const DenormalGuard denormals(in_size == 4);
+
+    // fast mode: the half resolution copies of the current frame and of the frames used for the bound.
+    std::shared_ptr<const HalfFrame> hcurr, hprev[MAX_STRENGTH], hnext[MAX_STRENGTH];
+    if (fast)
+    {
+        hcurr = get_half(n, curr);
+        if (fstrength == 0)
+            hprev[1] = hcurr;
+        for (int k = 1; k < fprev; ++k)
+            hprev[k] = get_half(max(n - k - 1, afirst), prev[k]);
+        for (int k = 1; k < fstrength; ++k)
+            hnext[k] = causal ? hprev[k] : get_half(min(n + k + 1, alast), next[k]);
+    }
+    else if (f16)
+    {
+        // the frames of the bound only, the current frame and the nearest neighbours are read at full precision.
+        if (fstrength == 0)
+            hprev[1] = get_half(n, curr);
+        for (int k = 1; k < fprev; ++k)
+            hprev[k] = get_half(max(n - k - 1, afirst), prev[k]);
+        for (int k = 1; k < fstrength; ++k)
+            hnext[k] = causal ? hprev[k] : get_half(min(n + k + 1, alast), next[k]);
+    }
+
+    double mdiff[3] = {}, clamp_ratio[3] = {}, tdiff[3] = {};
+    for (int i = 0; i < planecount; ++i)
+    {
+        const int plane = current_planes[i];
+
+        if (processPlane[i])
+        {
+            int width = curr->GetRowSize(plane) / in_size;
+            int height = curr->GetHeight(plane);
+            int cpitch = curr->GetPitch(plane);
+            int dpitch = dst->GetPitch(plane);
+            const uint8_t* currp = curr->GetReadPtr(plane);
+            uint8_t* dstp = dst->GetWritePtr(plane);
+
+            const uint8_t* prevp[MAX_STRENGTH] = {}, * nextp[MAX_STRENGTH] = {};
+            int ppitch[MAX_STRENGTH] = {}, npitch[MAX_STRENGTH] = {};
+
+            for (int k = 0; k < np; ++k)
+            {
+                prevp[k] = prev[k]->GetReadPtr(plane);
+                ppitch[k] = prev[k]->GetPitch(plane);
+            }
+            for (int k = 0; k < nn; ++k)
+            {
+                nextp[k] = next[k]->GetReadPtr(plane);
+                npitch[k] = next[k]->GetPitch(plane);
+            }
+            if (f16)
+            {
+                for (int k = 1; k < np; ++k)
+                {
+                    prevp[k] = hprev[k]->ptr[i];
+                    ppitch[k] = hprev[k]->pitch[i];
+                }
+                for (int k = 1; k < nn; ++k)
+                {
+                    nextp[k] = hnext[k]->ptr[i];
+                    npitch[k] = hnext[k]->pitch[i];
+                }
+            }
+
+            // the strength of the plane, 1 (adaptive) or a level of the controller in between (budget).
+            const int pstrength = min(planeStrength[i], max(fstrength, 1));
+            const kernel_t kernel = pstrength == planeStrength[i] ? process[i] : pstrength == 1 ? process_weak[i] : process_level[i][pstrength - 1];
+            const kernel_t kernel_row = pstrength == planeStrength[i] ? process_row[i] : pstrength == 1 ? process_weak_row[i] : process_level_row[i][pstrength - 1];
+            const uint8_t* hrefp[MAX_STRENGTH * 2 - 2];
+            int nrefs = 0;
+            if (fast)
+            {
+                for (int k = 1; k < max(pstrength, 2); ++k)
+                    hrefp[nrefs++] = hprev[k]->ptr[i];
+                for (int k = 1; k < pstrength; ++k)
+                    hrefp[nrefs++] = hnext[k]->ptr[i];
+            }
+
+            // the statistics and the bound go through a copy of the parameters local to this frame.
+            OutputParams sparams;
+            PlaneStats pstats = {};
+            const OutputParams* op = oparams + i;
+            uint8_t* boundp = nullptr;
+            if (stats || bound)
+            {
+                sparams = oparams[i];
+                sparams.stats = &pstats;
+                if (bound)
+                {
+                    boundp = bframe->GetWritePtr(plane);
+                    sparams.bound = boundp;
+                    sparams.bstride = bframe->GetPitch(plane);
+                }
+                op = &sparams;
+            }
+
+            if (mask)
+            {
+                // Tiles outside the mask keep the current frame, tiles partly in the mask are filtered
+                // into a small buffer and blended, so the cost follows the masked area.
+                const uint8_t* maskp = mframe->GetReadPtr(plane);
+                const int mpitch = mframe->GetPitch(plane);
+                const int hpitch = fast ? hcurr->pitch[i] : 0;
+
+                std::vector<uint8_t> covers((width + TILE_WIDTH - 1) / TILE_WIDTH);
+
+                for (int y0 = 0; y0 < height; y0 += TILE_HEIGHT)
+                {
+                    const int th = min(TILE_HEIGHT, height - y0);
+                    const uint8_t* mrow = maskp + static_cast<size_t>(mpitch) * y0;
+                    for (size_t t = 0; t < covers.size(); ++t)
+                    {
+                        const int x0 = static_cast<int>(t) * TILE_WIDTH;
+                        const int tw = min(TILE_WIDTH, width - x0);
+                        switch (in_size)
+                        {
+                            case 1: covers[t] = tile_coverage<uint8_t>(mrow + x0, mpitch, tw, th, in_peak); break;
+                            case 2: covers[t] = tile_coverage<uint16_t>(mrow + x0 * 2, mpitch, tw, th, in_peak); break;
+                            default: covers[t] = tile_coverage<float>(mrow + x0 * 4, mpitch, tw, th, in_peak); break;
+                        }
+                    }
+
+                    // runs of empty or full tiles are handled at once, so that the rows are read in long streams.
+                    for (size_t t0 = 0, t1; t0 < covers.size(); t0 = t1)
+                    {
+                        const int cover = covers[t0];
+                        for (t1 = t0 + 1; cover != 1 && t1 < covers.size() && covers[t1] == cover; ++t1) {}
+
+                        const int x0 = static_cast<int>(t0) * TILE_WIDTH;
+                        const int tw = min(static_cast<int>(t1) * TILE_WIDTH, width) - x0;
+                        const size_t xo = static_cast<size_t>(x0) * in_size;
+                        const uint8_t* m = mrow + xo;
+                        const uint8_t* c = currp + static_cast<size_t>(cpitch) * y0 + xo;
+                        uint8_t* d = dstp + static_cast<size_t>(dpitch) * y0 + xo;
+
+                        if (bound)
+                        {
+                            sparams.bound = boundp + static_cast<size_t>(sparams.bstride) * y0 + xo;
+                            if (cover == 0)
+                                for (int y = 0; y < th; ++y)
+                                    memset(sparams.bound + static_cast<size_t>(sparams.bstride) * y, 0, tw * in_size);
+                        }
+
+                        if (cover == 0)
+                        {
+                            if (d != c)
+                                env->BitBlt(d, dpitch, c, cpitch, tw * in_size, th);
+                            continue;
+                        }
+
+                        uint8_t* out = cover == 2 ? d : tilep;
+                        const int opitch = cover == 2 ? dpitch : tpitch;
+                        const uint8_t* tprev[MAX_STRENGTH] = {}, * tnext[MAX_STRENGTH] = {};
+                        // f16: the references of the bound have 2-byte samples.
+                        for (int k = 0; k < np; ++k)
+                            tprev[k] = prevp[k] + static_cast<size_t>(ppitch[k]) * y0 + (f16 && k > 0 ? xo / 2 : xo);
+                        for (int k = 0; k < nn; ++k)
+                            tnext[k] = nextp[k] + static_cast<size_t>(npitch[k]) * y0 + (f16 && k > 0 ? xo / 2 : xo);
+
+                        if (fast)
+                        {
+                            const size_t hoffset = static_cast<size_t>(hpitch) * (y0 >> 1) + xo / 2;
+                            const uint8_t* hr[MAX_STRENGTH * 2 - 2];
+                            for (int k = 0; k < nrefs; ++k)
+                                hr[k] = hrefp[k] + hoffset;
+                            (cover == 2 ? process_fast[i] : process_fast_row[i])(out, c, tprev[0], tnext[0], hcurr->ptr[i] + hoffset, hr, opitch, cpitch, ppitch[0], npitch[0], hpitch, nrefs, tw, th, op);
+                        }
+                        else if (cover == 2)
+                            kernel(out, c, tprev, tnext, opitch, cpitch, ppitch, npitch, tw, th, pstrength, op);
+                        else
+                            kernel_row(out, c, tprev, tnext, opitch, cpitch, ppitch, npitch, tw, th, pstrength, op);
+
+                        if (cover == 1)
+                        {
+                            switch (in_size)
+                            {
+                                case 1: blend<uint8_t>(d, c, tilep, m, dpitch, cpitch, tpitch, mpitch, tw, th, in_peak); break;
+                                case 2: blend<uint16_t>(d, c, tilep, m, dpitch, cpitch, tpitch, mpitch, tw, th, in_peak); break;
+                                default: blend<float>(d, c, tilep, m, dpitch, cpitch, tpitch, mpitch, tw, th, in_peak); break;
+                            }
+                        }
+                    }
+                }
+            }
+            else if (spatial)
+            {
+                // The filtered rows go by strips through a small buffer, where the spatial routine reads them one row behind:
+                // output row y needs the filtered rows y - 1..y + 1, so each strip starts with the last two rows of the previous one.
+                // The first and the last rows of the plane are kept.
+                const int bpitch = (width * in_size + align - 1) / align * align;
+                std::unique_ptr<uint8_t[]> buff = spatial_pool[i].get(static_cast<size_t>(bpitch) * (SPATIAL_ROWS + 2) + align * 3);
+                // a register before and after the rows is read (only for the first and the last columns, which are kept).
+                uint8_t* bufp = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(buff.get()) + align - 1) & ~(align - 1)) + align;
+                uint8_t* rows = bufp + static_cast<size_t>(bpitch) * 2;
+                const size_t rsize = static_cast<size_t>(width) * in_size;
+                const int hpitch = fast ? hcurr->pitch[i] : 0;
+
+                for (int y0 = 0; y0 < height; y0 += SPATIAL_ROWS)
+                {
+                    const int h = min(SPATIAL_ROWS, height - y0);
+                    if (y0 > 0)
+                        memcpy(bufp, bufp + static_cast<size_t>(bpitch) * SPATIAL_ROWS, static_cast<size_t>(bpitch) * 2);
+
+                    const uint8_t* c = currp + static_cast<size_t>(cpitch) * y0;
+                    if (bound)
+                        sparams.bound = boundp + static_cast<size_t>(sparams.bstride) * y0;
+                    const uint8_t* tprev[MAX_STRENGTH] = {}, * tnext[MAX_STRENGTH] = {};
+                    for (int k = 0; k < np; ++k)
+                        tprev[k] = prevp[k] + static_cast<size_t>(ppitch[k]) * y0;
+                    for (int k = 0; k < nn; ++k)
+                        tnext[k] = nextp[k] + static_cast<size_t>(npitch[k]) * y0;
+
+                    if (fast)
+                    {
+                        // SPATIAL_ROWS is even: the strips start on the rows of the half resolution copies.
+                        const size_t hoffset = static_cast<size_t>(hpitch) * (y0 >> 1);
+                        const uint8_t* hr[MAX_STRENGTH * 2 - 2];
+                        for (int k = 0; k < nrefs; ++k)
+                            hr[k] = hrefp[k] + hoffset;
+                        process_fast_row[i](rows, c, tprev[0], tnext[0], hcurr->ptr[i] + hoffset, hr, bpitch, cpitch, ppitch[0], npitch[0], hpitch, nrefs, width, h, op);
+                    }
+                    else
+                        kernel_row(rows, c, tprev, tnext, bpitch, cpitch, ppitch, npitch, width, h, pstrength, op);
+
+                    // inplace: the rows written here have all been read by the temporal routine.
+                    if (y0 == 0)
+                        memcpy(dstp, rows, rsize);
+                    const int y1 = max(y0 - 1, 1), y2 = y0 + h - 1;
+                    if (y2 > y1)
+                        process_spatial[i](dstp + static_cast<size_t>(dpitch) * y1, bufp + static_cast<size_t>(bpitch) * (y1 - y0 + 2), dpitch, bpitch, width, y2 - y1);
+                    if (y0 + h == height && height > 1)
+                        memcpy(dstp + static_cast<size_t>(dpitch) * (height - 1), rows + static_cast<size_t>(bpitch) * (h - 1), rsize);
+                }
+                spatial_pool[i].put(std::move(buff));
+            }
+            else if (nvariants > 1)
+            {
+                uint8_t* vdstp[MAX_VARIANTS];
+                int vpitch[MAX_VARIANTS];
+                for (int v = 0; v < nvariants; ++v)
+                {
+                    vdstp[v] = vframes[v]->GetWritePtr(plane);
+                    vpitch[v] = vframes[v]->GetPitch(plane);
+                }
+                process_multi[i](vdstp, currp, prevp, nextp, vpitch, cpitch, ppitch, npitch, width, height, variants, nvariants, op);
+            }
+            else if (dither != 1)
+            {
+                if (fast)
+                    process_fast[i](dstp, currp, prevp[0], nextp[0], hcurr->ptr[i], hrefp, dpitch, cpitch, ppitch[0], npitch[0], hcurr->pitch[i], nrefs, width, height, op);
+                else
+                    kernel(dstp, currp, prevp, nextp, dpitch, cpitch, ppitch, npitch, width, height, pstrength, op);
+            }
+            else
+            {
+                // error diffusion is serial, so the filtered rows go through a small buffer first.
+                const size_t bsize = (static_cast<size_t>(width) * in_size + align - 1) / align * align;
+                std::vector<uint8_t> buff(bsize + align + sizeof(float) * (width + 2) * 2);
+                uint8_t* rowp = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(buff.data()) + align - 1) & ~(align - 1));
+                void* err[2] = { rowp + bsize, rowp + bsize + sizeof(float) * (width + 2) };
+                std::fill_n(reinterpret_cast<float*>(err[0]), width + 2, 0.0f);
+
+                for (int y = 0; y < height; ++y)
+                {
+                    if (fast)
+                    {
+                        const size_t hoffset = static_cast<size_t>(hcurr->pitch[i]) * (y >> 1);
+                        const uint8_t* hr[MAX_STRENGTH * 2 - 2];
+                        for (int k = 0; k < nrefs; ++k)
+                            hr[k] = hrefp[k] + hoffset;
+                        process_fast_row[i](rowp, currp, prevp[0], nextp[0], hcurr->ptr[i] + hoffset, hr, 0, cpitch, 0, 0, 0, nrefs, width, 1, op);
+                    }
+                    else
+                        kernel_row(rowp, currp, prevp, nextp, 0, cpitch, ppitch, npitch, width, 1, pstrength, op);
+                    if (in_size == 2)
+                        error_diffusion<uint16_t>(dstp, rowp, width, err[y & 1], err[(y & 1) ^ 1], oparams + i);
+                    else
+                        error_diffusion<float>(dstp, rowp, width, err[y & 1], err[(y & 1) ^ 1], oparams + i);
+
+                    currp += cpitch;
+                    dstp += dpitch;
+                    for (int j = 0; j < MAX_STRENGTH; ++j)
+                    {
+                        prevp[j] += ppitch[j];
+                        nextp[j] += npitch[j];
+                    }
+                }
+            }
+
+            if (stats)
+            {
+                const double pixels = static_cast<double>(width) * height;
+                mdiff[i] = pstats.diff / pixels / in_peak;
+                clamp_ratio[i] = pstats.clamped / pixels;
+                tdiff[i] = pstats.tdiff / pixels / in_peak;
+            }
+        }
+        else if (bound)
+        {
+            // the planes that are copied have no bound.
+            uint8_t* boundp = bframe->GetWritePtr(plane);
+            const int bpitch = bframe->GetPitch(plane);
+            for (int y = 0; y < bframe->GetHeight(plane); ++y)
+                memset(boundp + static_cast<size_t>(bpitch) * y, 0, bframe->GetRowSize(plane));
+        }
+    }
+
+    if (bound)
+        env->propSetFrame(env->getFramePropsRW(dst), "ReduceFlickerBound", bframe, 0);
+
+    if (nvariants > 1)
+    {
+        AVSMap* props = env->getFramePropsRW(dst);
+        for (int v = 1; v < nvariants; ++v)
+            env->propSetFrame(props, "ReduceFlickerVariants", vframes[v], v == 1 ? PROPAPPENDMODE_REPLACE : PROPAPPENDMODE_APPEND);
+    }
+
+    if (stats)
+    {
+        AVSMap* props = env->getFramePropsRW(dst);
+        env->propSetFloatArray(props, "ReduceFlickerDiff", mdiff, planecount);
+        env->propSetFloatArray(props, "ReduceFlickerClamped", clamp_ratio, planecount);
+        env->propSetFloatArray(props, "ReduceFlickerTemporalDiff", tdiff, planecount);
+        if (skip > 0.0f || weak > 0.0f)
+            env->propSetInt(props, "ReduceFlickerStrength", fstrength, 0);
+    }
+
+    if (cache)
+    {
+        uint8_t* slot = cache->begin_store(n - first);
+        for (int i = 0; i < planecount; ++i)
+            if (processPlane[i])
+            {
+                const int plane = current_planes[i];
+                env->BitBlt(slot + cache_offsets[i], dst->GetRowSize(plane), dst->GetReadPtr(plane), dst->GetPitch(plane), dst->GetRowSize(plane), dst->GetHeight(plane));
+            }
+        cache->commit(n - first, key);
+    }
+
+    if (budget > 0.0)
+    {
+        env->propSetInt(env->getFramePropsRW(dst), "ReduceFlickerLevel", level, 0);
+        qos.update(level, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return dst;
+}
+
+// budget: the current frame is the output, tagged with the level like the filtered ones (its buffer isn't copied).
+PVideoFrame ReduceFlicker::pass_through(PVideoFrame& curr, int level, std::chrono::steady_clock::time_point start, IScriptEnvironment* env)
+{
+    env->MakePropertyWritable(&curr);
+    env->propSetInt(env->getFramePropsRW(curr), "ReduceFlickerLevel", level, 0);
+    qos.update(level, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return curr;
+}
+
+// "1 2 3 1a 2a 3a": strengths, "a" for aggressive, separated by spaces or commas. -1 when it isn't valid.
+static int parse_variants(const char* s, Variant* variants)
+{
+    int count = 0;
+    while (*s)
+    {
+        if (*s == ' ' || *s == ',')
+        {
+            ++s;
+            continue;
+        }
+        if (*s < '1' || *s > '0' + MAX_STRENGTH || count == MAX_VARIANTS)
+            return -1;
+        variants[count].strength = *s++ - '0';
+        variants[count].aggressive = *s == 'a';
+        if (*s == 'a')
+            ++s;
+        if (*s && *s != ' ' && *s != ',')
+            return -1;
+        ++count;
+    }
+    return count > 0 ? count : -1;
+}
+
+AVSValue __cdecl Create_ReduceFlicker(AVSValue args, void*, IScriptEnvironment* env)
+{
+    PClip clip = args[0].AsClip();
     const VideoInfo& vi = clip->GetVideoInfo();
 
     if (!vi.IsPlanar())
         env->ThrowError("ReduceFlicker: input clip must be in planar format.");
 
+    Variant variants[MAX_VARIANTS];
+    int nvariants = 0;
+    if (args[28].Defined())
+    {
+        nvariants = parse_variants(args[28].AsString(), variants);
+        if (nvariants < 1)
+            env->ThrowError("ReduceFlicker: variants must list 1..8 strengths between 1..8, each followed by \"a\" when aggressive.");
+        if (args[1].Defined() || args[2].Defined() || args[15].Defined() || args[16].Defined())
+            env->ThrowError("ReduceFlicker: variants can't be used with strength, aggressive, cstrength or caggressive.");
+    }
+
     int strength = args[1].AsInt(2);
-    if (strength < 1 || strength > 3)
-        env->ThrowError("ReduceFlicker: strength must be set to 1, 2 or 3.");
+    if (strength < 1 || strength > MAX_STRENGTH)
+        env->ThrowError("ReduceFlicker: strength must be between 1..8.");
+    // variants: the frames of the widest one are requested.
+    if (nvariants > 0)
+    {
+        strength = 1;
+        for (int v = 0; v < nvariants; ++v)
+            strength = max(strength, variants[v].strength);
+    }
+
+    const int cstrength = args[15].AsInt(strength);
+    if (cstrength < 1 || cstrength > MAX_STRENGTH)
+        env->ThrowError("ReduceFlicker: cstrength must be between 1..8.");
+
+    const int store_policy = args[17].AsInt(-1);
+    if (store_policy < -1 || store_policy > 1)
+        env->ThrowError("ReduceFlicker: store must be between -1..1.");
 
     int opt = args[4].AsInt(-1);
     if (opt < -1 || opt > 2)
         env->ThrowError("ReduceFlicker: opt must be between -1..2.");
+    if (!REDUCEFLICKER_X86 && opt > 0)
+        env->ThrowError("ReduceFlicker: opt=1 and opt=2 are x86 only.");
     if (!(env->GetCPUFlags() & CPUF_AVX2) && opt == 2)
         env->ThrowError("ReduceFlicker: opt=2 requires AVX2.");
+    if (!(env->GetCPUFlags() & CPUF_FMA3) && opt == 2 && vi.ComponentSize() == 4)
+        env->ThrowError("ReduceFlicker: opt=2 requires FMA3 for 32-bit clips.");
     if (!(env->GetCPUFlags() & CPUF_SSE2) && opt == 1)
         env->ThrowError("ReduceFlicker: opt=1 requires SSE2.");
 
-    return new ReduceFlicker(
-        clip,
-        strength,
-        args[2].AsBool(false),
-        args[3].AsBool(false),
-        opt,
-        args[5].AsBool(true),
-        args[6].AsBool(true),
-        env);
+    const int bits = args[7].AsInt(vi.BitsPerComponent());
+    if (bits != vi.BitsPerComponent() && (bits < 8 || bits > 16 || bits & 1 || (vi.ComponentSize() != 4 && bits > vi.BitsPerComponent())))
+        env->ThrowError("ReduceFlicker: bits must be 8, 10, 12, 14 or 16 and lower than the input bit depth.");
+
+    const int dither = args[8].AsInt(-1);
+    if (dither < -1 || dither > 1)
+        env->ThrowError("ReduceFlicker: dither must be between -1..1.");
+
+    const int afirst = args[10].AsInt(0);
+    const int alast = args[11].AsInt(vi.num_frames - 1);
+    if (afirst < 0 || alast >= vi.num_frames || afirst > alast)
+        env->ThrowError("ReduceFlicker: afirst and alast must be within the input clip, afirst <= alast.");
+
+    const int first = args[12].AsInt(afirst);
+    const int last = args[13].AsInt(alast);
+    if (first < afirst || last > alast || first > last)
+        env->ThrowError("ReduceFlicker: first and last must be within afirst..alast, first <= last.");
+
+    const bool aggressive = nvariants > 0 ? variants[0].aggressive : args[2].AsBool(false);
+
+    const float skip = args[19].AsFloatf(0.0f);
+    const float weak = args[20].AsFloatf(0.0f);
+    if (skip < 0.0f || weak < 0.0f)
+        env->ThrowError("ReduceFlicker: skip and weak must be positive.");
+
+    PClip mask;
+    if (args[21].Defined())
+    {
+        mask = args[21].AsClip();
+        const VideoInfo& mvi = mask->GetVideoInfo();
+        if (!mvi.IsSameColorspace(vi) || mvi.width != vi.width || mvi.height != vi.height)
+            env->ThrowError("ReduceFlicker: mask must have the same format and dimensions as clip.");
+        if (args[7].Defined() && args[7].AsInt() != vi.BitsPerComponent())
+            env->ThrowError("ReduceFlicker: mask can't be used with bits.");
+    }
+
+    const bool stats = args[18].AsBool(false);
+    if (stats)
+    {
+        try { env->CheckVersion(8); }
+        catch (const AvisynthError&) { env->ThrowError("ReduceFlicker: stats requires AviSynth+ 3.6 or later."); }
+    }
+
+    const int ring = args[22].AsInt(0);
+    if (ring < -1)
+        env->ThrowError("ReduceFlicker: ring must be -1 or positive.");
+
+    const char* cache_path = args[23].AsString(nullptr);
+    if (cache_path && stats)
+        env->ThrowError("ReduceFlicker: cache can't be used with stats.");
+
+    const bool f16 = args[24].AsBool(false);
+    if (f16 && vi.ComponentSize() != 4)
+        env->ThrowError("ReduceFlicker: f16 is only for 32-bit clips.");
+    if (f16 && args[14].AsBool(false))
+        env->ThrowError("ReduceFlicker: f16 can't be used with fast.");
+
+    const int spatial = args[26].AsInt(0);
+    if (spatial < 0 || spatial > 4)
+        env->ThrowError("ReduceFlicker: spatial must be between 0..4.");
+    if (spatial && mask)
+        env->ThrowError("ReduceFlicker: spatial can't be used with mask.");
+    if (spatial && args[7].Defined() && args[7].AsInt() != vi.BitsPerComponent())
+        env->ThrowError("ReduceFlicker: spatial can't be used with bits.");
+
+    const bool bound = args[27].AsBool(false);
+    if (bound)
+    {
+        try { env->CheckVersion(8); }
+        catch (const AvisynthError&) { env->ThrowError("ReduceFlicker: bound requires AviSynth+ 3.6 or later."); }
+        if (args[7].Defined() && args[7].AsInt() != vi.BitsPerComponent())
+            env->ThrowError("ReduceFlicker: bound can't be used with bits.");
+        if (cache_path)
+            env->ThrowError("ReduceFlicker: cache can't be used with bound.");
+    }
+
+    if (nvariants > 1)
+    {
+        try { env->CheckVersion(8); }
+        catch (const AvisynthError&) { env->ThrowError("ReduceFlicker: variants requires AviSynth+ 3.6 or later."); }
+        if ((args[7].Defined() && args[7].AsInt() != vi.BitsPerComponent()) || args[9].AsBool(false) || args[14].AsBool(false) || stats || skip > 0.0f || weak > 0.0f ||
+            mask || cache_path || f16 || args[25].AsBool(false) || spatial || bound || args[29].AsFloatf(0.0f) > 0.0f)
+            env->ThrowError("ReduceFlicker: variants can't be used with bits, inplace, fast, stats, skip, weak, mask, cache, f16, causal, spatial, bound or budget.");
+    }
+
+    const float budget = args[29].AsFloatf(0.0f);
+    if (budget < 0.0f)
+        env->ThrowError("ReduceFlicker: budget must be positive.");
+    // the cached frames would keep the level of the pass that wrote them.
+    if (budget > 0.0f && cache_path)
+        env->ThrowError("ReduceFlicker: budget can't be used with cache.");
+    if (budget > 0.0f)
+    {
+        try { env->CheckVersion(8); }
+        catch (const AvisynthError&) { env->ThrowError("ReduceFlicker: budget requires AviSynth+ 3.6 or later."); }
+    }
+
+    ReduceFlickerParams p;
+    p.strength = strength;
+    p.aggressive = aggressive;
+    p.grey = args[3].AsBool(false);
+    p.opt = opt;
+    p.raccess = args[5].AsBool(true);
+    p.luma = args[6].AsBool(true);
+    p.bits = bits;
+    p.dither = dither;
+    p.inplace = args[9].AsBool(false);
+    p.first = first;
+    p.last = last;
+    p.afirst = afirst;
+    p.alast = alast;
+    p.fast = args[14].AsBool(false);
+    p.cstrength = cstrength;
+    p.caggressive = args[16].AsBool(aggressive);
+    p.store = store_policy;
+    p.stats = stats;
+    p.skip = skip;
+    p.weak = weak;
+    p.mask = mask;
+    p.ring = ring;
+    p.cache = cache_path;
+    p.f16 = f16;
+    p.causal = args[25].AsBool(false);
+    p.spatial = spatial;
+    p.bound = bound;
+    for (int v = 0; v < nvariants; ++v)
+        p.variants[v] = variants[v];
+    p.nvariants = nvariants;
+    p.budget = budget;
+
+    return new ReduceFlicker(clip, p, env);
+}
+
+PVideoFrame __stdcall ReduceFlickerBound::GetFrame(int n, IScriptEnvironment* env)
+{
+    PVideoFrame src = child->GetFrame(n, env);
+    int err = 0;
+    PVideoFrame bound = env->propGetFrame(env->getFramePropsRO(src), "ReduceFlickerBound", 0, &err);
+    if (err)
+        env->ThrowError("ReduceFlickerBound: clip must be ReduceFlicker(bound=true).");
+    return bound;
+}
+
+PVideoFrame __stdcall ReduceFlickerVariant::GetFrame(int n, IScriptEnvironment* env)
+{
+    PVideoFrame src = child->GetFrame(n, env);
+    if (index == 0)
+        return src;
+    int err = 0;
+    PVideoFrame variant = env->propGetFrame(env->getFramePropsRO(src), "ReduceFlickerVariants", index - 1, &err);
+    if (err)
+        env->ThrowError("ReduceFlickerVariant: clip must be ReduceFlicker(variants=...) with more than index variants.");
+    return variant;
+}
+
+AVSValue __cdecl Create_ReduceFlickerVariant(AVSValue args, void*, IScriptEnvironment* env)
+{
+    const int index = args[1].AsInt(0);
+    if (index < 0 || index >= MAX_VARIANTS)
+        env->ThrowError("ReduceFlickerVariant: index must be between 0..7.");
+
+    return new ReduceFlickerVariant(args[0].AsClip(), index);
+}
+
+AVSValue __cdecl Create_ReduceFlickerBound(AVSValue args, void*, IScriptEnvironment* env)
+{
+    try { env->CheckVersion(8); }
+    catch (const AvisynthError&) { env->ThrowError("ReduceFlickerBound: requires AviSynth+ 3.6 or later."); }
+
+    return new ReduceFlickerBound(args[0].AsClip());
+}
+
+// C interface for planes held in memory (ReduceFlicker_API.h).
+static int get_cpu_isa()
+{
+#if !REDUCEFLICKER_X86
+    return 0;
+#elif defined(_WIN32)
+#ifdef PF_AVX2_INSTRUCTIONS_AVAILABLE
+    if (IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+        return 2;
+#endif
+    return IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) ? 1 : 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse2") ? 1 : 0;
+#endif
+}
+
+// The AVX2 float routines also need FMA3, float planes use SSE2 without it.
+static bool get_cpu_fma3()
+{
+#if !REDUCEFLICKER_X86
+    return false;
+#elif defined(_WIN32)
+    int info[4];
+    __cpuid(info, 1);
+    return !!(info[2] & (1 << 12));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma");
+#endif
+}
+
+// -1: opt isn't supported by the cpu.
+static int get_isa(int opt)
+{
+    const int cpu = get_cpu_isa();
+    if (opt < -1 || opt > cpu)
+        return -1;
+    return opt < 0 ? cpu : opt;
+}
+
+static bool check_stream(const ReduceFlickerStream& s)
+{
+    if (!s.dst || !s.dpitch || !s.src || !s.spitch || s.num_frames < 1 || s.first < 0 || s.last >= s.num_frames || s.first > s.last || s.width < 1 || s.height < 1)
+        return false;
+    if (s.strength < 1 || s.strength > MAX_STRENGTH || s.bits < 8 || (s.bits > 16 && s.bits != 32))
+        return false;
+
+    const int size = s.bits == 8 ? 1 : s.bits == 32 ? 4 : 2;
+    for (int n = 0; n < s.num_frames; ++n)
+        if (!s.src[n] || s.spitch[n] < s.width * size)
+            return false;
+    for (int n = 0; n <= s.last - s.first; ++n)
+        if (!s.dst[n] || s.dpitch[n] < s.width * size)
+            return false;
+    return true;
+}
+
+// The SIMD routines read and write whole registers, so they only get a multiple of the register size of the rows
+// and the last columns go through the C routine. The AVX2 routines take unaligned rows (planes of a mapped file)
+// but for the non-temporal stores, the SSE2 routines need all the rows aligned to 16 bytes, otherwise C is used.
+template <typename T>
+static void process_frame(const ReduceFlickerStream& s, int n, int isa, int store)
+{
+    const int strength = s.strength;
+    const int nprev = max(strength, 2);
+    OutputParams op = {};
+
+    const uint8_t* prevp[MAX_STRENGTH] = {}, * nextp[MAX_STRENGTH] = {};
+    int ppitch[MAX_STRENGTH] = {}, npitch[MAX_STRENGTH] = {};
+    for (int k = 1; k <= nprev; ++k)
+    {
+        prevp[k - 1] = s.src[max(n - k, 0)];
+        ppitch[k - 1] = s.spitch[max(n - k, 0)];
+    }
+    for (int k = 1; k <= strength; ++k)
+    {
+        nextp[k - 1] = s.src[min(n + k, s.num_frames - 1)];
+        npitch[k - 1] = s.spitch[min(n + k, s.num_frames - 1)];
+    }
+    uint8_t* dstp = s.dst[n - s.first];
+    const uint8_t* currp = s.src[n];
+    const int dpitch = s.dpitch[n - s.first];
+    const int cpitch = s.spitch[n];
+
+    // alignment of the rows of the output, and of all the rows (SSE2)
+    const uintptr_t dbits = reinterpret_cast<uintptr_t>(dstp) | static_cast<unsigned>(dpitch);
+    uintptr_t bits = dbits | reinterpret_cast<uintptr_t>(currp) | static_cast<unsigned>(cpitch);
+    for (int k = 0; k < nprev; ++k)
+        bits |= reinterpret_cast<uintptr_t>(prevp[k]) | static_cast<unsigned>(ppitch[k]);
+    for (int k = 0; k < strength; ++k)
+        bits |= reinterpret_cast<uintptr_t>(nextp[k]) | static_cast<unsigned>(npitch[k]);
+
+    int vwidth = 0;
+    for (int i = isa; i > 0 && vwidth == 0; --i)
+    {
+        const bool aligned = i == 2 ? store_mode(store) != STORE_STREAM || dbits % 32 == 0 : bits % 16 == 0;
+        if (aligned)
+        {
+            const size_t vsize = i == 2 ? 32 : 16;
+            vwidth = static_cast<int>(s.width * sizeof(T) / vsize * vsize / sizeof(T));
+            if (vwidth > 0)
+                get_kernel<T>(i, !!s.aggressive, strength, store)(dstp, currp, prevp, nextp, dpitch, cpitch, ppitch, npitch, vwidth, s.height, strength, &op);
+        }
+    }
+    if (vwidth < s.width)
+    {
+        const size_t offset = vwidth * sizeof(T);
+        for (int k = 0; k < nprev; ++k)
+            prevp[k] += offset;
+        for (int k = 0; k < strength; ++k)
+            nextp[k] += offset;
+        get_kernel<T>(0, !!s.aggressive, strength, store)(dstp + offset, currp + offset, prevp, nextp, dpitch, cpitch, ppitch, npitch, s.width - vwidth, s.height, strength, &op);
+    }
+}
+
+static void process_frame(const ReduceFlickerStream& s, int n, int isa, int store = STORE_CACHED)
+{
+    switch (s.bits)
+    {
+        case 8: process_frame<uint8_t>(s, n, isa, store); break;
+        case 16: process_frame<uint16_t>(s, n, isa, store); break;
+        case 32:
+        {
+            static const bool fma3 = get_cpu_fma3();
+            const DenormalGuard denormals(true);
+            process_frame<float>(s, n, isa == 2 && !fma3 ? 1 : isa, store);
+            break;
+        }
+        default: process_frame<int16_t>(s, n, isa, store); break;
+    }
+}
+
+int ReduceFlicker_Process(uint8_t* const* dst, const int* dpitch, const uint8_t* const* src, const int* spitch, int num_frames, int first, int last, int width, int height, int bits, int strength, int aggressive, int opt)
+{
+    const ReduceFlickerStream s = { dst, dpitch, src, spitch, num_frames, first, last, width, height, bits, strength, aggressive };
+    const int isa = get_isa(opt);
+    if (isa < 0 || !check_stream(s))
+        return -1;
+
+    for (int n = first; n <= last; ++n)
+        process_frame(s, n, isa);
+    return 0;
+}
+
+// The jobs are the frames of all the streams in order, the k-th frames of the streams one after the other (e.g. the planes
+// of a frame of a file): the threads take the next one from a shared counter, so they work on neighbouring frames
+// and the references they read are in the cache.
+int ReduceFlicker_ProcessBatch(const ReduceFlickerStream* streams, int num_streams, int threads, int opt)
+{
+    const int isa = get_isa(opt);
+    if (isa < 0 || num_streams < 0 || (num_streams > 0 && !streams) || threads < 0)
+        return -1;
+
+    int length = 0;
+    size_t num_jobs = 0;
+    for (int i = 0; i < num_streams; ++i)
+    {
+        if (!check_stream(streams[i]))
+            return -1;
+        length = max(length, streams[i].last - streams[i].first + 1);
+        num_jobs += static_cast<size_t>(streams[i].last - streams[i].first) + 1;
+    }
+    std::vector<std::pair<int, int>> jobs;
+    jobs.reserve(num_jobs);
+    for (int k = 0; k < length; ++k)
+        for (int i = 0; i < num_streams; ++i)
+            if (streams[i].first + k <= streams[i].last)
+                jobs.emplace_back(i, streams[i].first + k);
+
+    if (threads == 0)
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = static_cast<int>(min<size_t>(max(threads, 1), jobs.size()));
+
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&]()
+    {
+        for (size_t j; (j = next.fetch_add(1, std::memory_order_relaxed)) < jobs.size();)
+            process_frame(streams[jobs[j].first], jobs[j].second, isa);
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i)
+    {
+        // the calling thread and the threads already started do the rest.
+        try { pool.emplace_back(worker); }
+        catch (const std::system_error&) { break; }
+    }
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    return 0;
+}
+
+// Synthetic clip of the profile: a pattern with noise and a flicker of the whole frame.
+template <typename T>
+static void fill_plane(uint8_t* p, int pitch, int width, int height, int n, int bits)
+{
+    const float peak = std::is_integral_v<T> ? static_cast<float>((1 << bits) - 1) : 1.0f;
+    uint32_t r = 2463534242u + 7919u * n;
+    for (int y = 0; y < height; ++y)
+    {
+        T* row = reinterpret_cast<T*>(p + static_cast<size_t>(pitch) * y);
+        for (int x = 0; x < width; ++x)
+        {
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+            const float v = ((x * 3 + y * 5) & 255) * (0.8f / 255.0f) + (n & 1) * 0.05f + (r & 15) * (1.0f / 255.0f);
+            row[x] = static_cast<T>(v * peak);
+        }
+    }
+}
+
+static void print_value(FILE* f, int width, const char* format, double v, bool valid)
+{
+    if (valid)
+        fprintf(f, format, width, v);
+    else
+        fprintf(f, " %*s", width - 1, "-");
+}
+
+// Each routine filters all the frames once after one frame of warm-up. The frames are distinct buffers, so the references
+// come from the caches or from memory like in a script; the outputs alternate between two buffers like recycled frames.
+int ReduceFlicker_Profile(int width, int height, int num_frames, int strength, int opt, const char* path)
+{
+    const int cpu = get_cpu_isa();
+    if (width < 1 || height < 1 || num_frames < 1 || strength < 0 || strength > MAX_STRENGTH || opt < -1 || opt > cpu)
+        return -1;
+
+    FILE* f = path ? fopen(path, "w") : stdout;
+    if (!f)
+        return -1;
+
+    PerfCounters counters;
+    const double peak = copy_bandwidth();
+    fprintf(f, "# %dx%d, %d frames, copy bandwidth %.2f GB/s, last level cache %d KiB\n", width, height, num_frames, peak * 1e-9, static_cast<int>(get_llc_size() >> 10));
+    fprintf(f, "# B/px: bytes of the rows read and written by the routine per pixel, GB/s and %%peak: as if they all came from memory.\n");
+    fprintf(f, "# DRAM B/px: 64 * LLC misses + output bytes (the stores reach memory), DRAM GB/s and DRAM %%peak follow from it.\n");
+    fprintf(f, "%-5s %4s %2s %-4s %-6s %9s %7s %9s %5s %5s %7s %6s %8s %9s %9s %10s\n",
+        "isa", "bits", "s", "mode", "store", "ms/frame", "ns/px", "cycles/px", "IPC", "B/px", "GB/s", "%peak", "miss/px", "DRAM B/px", "DRAM GB/s", "DRAM %peak");
+
+    static constexpr const char* isa_names[3] = { "C", "SSE2", "AVX2" };
+    static constexpr int bits_list[4] = { 8, 10, 16, 32 };
+    int ret = 0;
+    for (const int bits : bits_list)
+    {
+        const int size = bits == 8 ? 1 : bits == 32 ? 4 : 2;
+        const int pitch = (width * size + 63) / 64 * 64;
+        const size_t plane = static_cast<size_t>(pitch) * height;
+        std::unique_ptr<uint8_t[]> buff(new (std::nothrow) uint8_t[plane * (num_frames + 2) + 64]);
+        if (!buff)
+        {
+            ret = -1;
+            break;
+        }
+        uint8_t* base = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(buff.get()) + 63) & ~static_cast<uintptr_t>(63));
+
+        std::vector<const uint8_t*> src(num_frames);
+        std::vector<uint8_t*> dst(num_frames);
+        const std::vector<int> pitches(num_frames, pitch);
+        for (int n = 0; n < num_frames; ++n)
+        {
+            uint8_t* p = base + plane * n;
+            switch (size)
+            {
+                case 1: fill_plane<uint8_t>(p, pitch, width, height, n, bits); break;
+                case 2: fill_plane<uint16_t>(p, pitch, width, height, n, bits); break;
+                default: fill_plane<float>(p, pitch, width, height, n, bits); break;
+            }
+            src[n] = p;
+            dst[n] = base + plane * (num_frames + (n & 1));
+        }
+        ReduceFlickerStream s = { dst.data(), pitches.data(), src.data(), pitches.data(), num_frames, 0, num_frames - 1, width, height, bits, 0, 0 };
+
+        for (int isa = opt < 0 ? 0 : opt; isa <= (opt < 0 ? cpu : opt); ++isa)
+            for (int st = strength > 0 ? strength : 1; st <= (strength > 0 ? strength : MAX_STRENGTH); ++st)
+                for (int ag = 0; ag < 2; ++ag)
+                    for (const int store : { STORE_STREAM, STORE_CACHED })
+                    {
+                        s.strength = st;
+                        s.aggressive = ag;
+                        process_frame(s, 0, isa, store);
+                        counters.start();
+                        for (int n = 0; n < num_frames; ++n)
+                            process_frame(s, n, isa, store);
+                        const PerfSample r = counters.stop();
+
+                        const double pixels = static_cast<double>(width) * height * num_frames;
+                        const double bytes = (max(st, 2) + 1 + st + 1) * static_cast<double>(size);
+                        const bool hw = r.llc_misses >= 0;
+                        const double dram = hw ? 64.0 * r.llc_misses / pixels + size : 0.0;
+                        const double rate = bytes * pixels / r.seconds;
+                        const double dram_rate = dram * pixels / r.seconds;
+
+                        fprintf(f, "%-5s %4d %2d %-4s %-6s", isa_names[isa], bits, st, ag ? "a" : "n", store == STORE_STREAM ? "stream" : "cached");
+                        print_value(f, 10, " %*.3f", r.seconds * 1e3 / num_frames, true);
+                        print_value(f, 8, " %*.3f", r.seconds * 1e9 / pixels, true);
+                        print_value(f, 10, " %*.3f", r.cycles / pixels, hw);
+                        print_value(f, 6, " %*.2f", static_cast<double>(r.instructions) / r.cycles, hw && r.cycles > 0);
+                        print_value(f, 6, " %*.0f", bytes, true);
+                        print_value(f, 8, " %*.2f", rate * 1e-9, true);
+                        print_value(f, 7, " %*.1f", rate * 100.0 / peak, peak > 0.0);
+                        print_value(f, 9, " %*.4f", r.llc_misses / pixels, hw);
+                        print_value(f, 10, " %*.2f", dram, hw);
+                        print_value(f, 10, " %*.2f", dram_rate * 1e-9, hw);
+                        print_value(f, 11, " %*.1f", dram_rate * 100.0 / peak, hw && peak > 0.0);
+                        fprintf(f, "\n");
+                    }
+    }
+
+    if (path)
+        fclose(f);
+    else
+        fflush(f);
+    return ret;
 }
 
 const AVS_Linkage* AVS_linkage = nullptr;
@@ -538,7 +2680,9 @@ AvisynthPluginInit3(IScriptEnvironment * env, const AVS_Linkage* const vectors)
 {
     AVS_linkage = vectors;
 
-    env->AddFunction("ReduceFlicker", "c[strength]i[aggressive]b[grey]b[opt]i[raccess]b[luma]b", Create_ReduceFlicker, 0);
+    env->AddFunction("ReduceFlicker", "c[strength]i[aggressive]b[grey]b[opt]i[raccess]b[luma]b[bits]i[dither]i[inplace]b[afirst]i[alast]i[first]i[last]i[fast]b[cstrength]i[caggressive]b[store]i[stats]b[skip]f[weak]f[mask]c[ring]i[cache]s[f16]b[causal]b[spatial]i[bound]b[variants]s[budget]f", Create_ReduceFlicker, 0);
+    env->AddFunction("ReduceFlickerBound", "c", Create_ReduceFlickerBound, 0);
+    env->AddFunction("ReduceFlickerVariant", "c[index]i", Create_ReduceFlickerVariant, 0);
 
     return "ReduceFlicker for avs2.6/avs+.";
 }
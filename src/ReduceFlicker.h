@@ -1,39 +1,438 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "avisynth.h"
 #include "avs/minmax.h"
 
+// The SSE2/AVX2 routines are only built for x86, elsewhere the C routines are the only ones.
+#ifndef REDUCEFLICKER_X86
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define REDUCEFLICKER_X86 1
+#else
+#define REDUCEFLICKER_X86 0
+#endif
+#endif
+
 #ifdef _MSC_VER
 #define F_INLINE __forceinline
 #elif defined(GCC) || defined(CLANG)
 #define F_INLINE inline __attribute__((__always_inline__))
 #endif
 
-template <typename T, int STRENGTH>
-void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template <typename T, int STRENGTH>
-void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+constexpr int MAX_STRENGTH = 8;
+constexpr int MAX_VARIANTS = 8;
+// f16: the half float references are used from this strength.
+constexpr int F16_MIN_STRENGTH = 4;
 
-template <typename T, int STRENGTH>
-void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template <typename T, int STRENGTH>
-void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+enum StoreMode
+{
+    STORE_STREAM,   // same format as the input, non-temporal stores
+    STORE_CACHED,   // same format as the input, regular stores
+    STORE_TO8,      // converted to 8-bit
+    STORE_TO16,     // converted to 10..16-bit
+    STORE_STATS = 4,    // flag: the kernel also accumulates the statistics of the plane into OutputParams::stats
+    STORE_BOUND = 8,    // flag: the kernel also writes the bound of each pixel into OutputParams::bound
+};
 
-class ReduceFlicker : public GenericVideoFilter
+constexpr int store_mode(int store) { return store & ~(STORE_STATS | STORE_BOUND); }
+
+// Sums over the pixels of a plane, in input sample units.
+struct PlaneStats
+{
+    double diff;        // |output - current|
+    double tdiff;       // |current - previous frame|
+    int64_t clamped;    // the output differs from the average of the neighbours
+};
+
+// Parameters of the bit-depth conversion fused into the store of the kernels.
+// Each row of 'ioffs'/'foffs' holds the rounding/dither offsets of a line (y & 7).
+struct OutputParams
+{
+    int shift;      // integer input: number of dropped bits
+    int peak;       // maximum output value
+    float scale;    // float input: output value of 1.0
+    alignas(32) int16_t ioffs[8][16];
+    alignas(32) float foffs[8][8];
+    PlaneStats* stats;
+    uint8_t* bound;     // plane of the bound (input format), at the origin of the rows of the call
+    int bstride;
+};
+
+// variants: strength and mode of one of the outputs of the multi-variant routines.
+struct Variant
 {
     int strength;
+    bool aggressive;
+};
+
+template <typename T, int STORE>
+using store_t = std::conditional_t<store_mode(STORE) == STORE_TO8, uint8_t, std::conditional_t<store_mode(STORE) == STORE_TO16, uint16_t, T>>;
+
+using kernel_t = void (*)(uint8_t*, const uint8_t*, const uint8_t**, const uint8_t**, int, int, const int*, const int*, int, int, int, const OutputParams*) noexcept;
+// fast mode: the bound is taken from the half resolution copies of the current frame and of the references.
+using fast_kernel_t = void (*)(uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t**, int, int, int, int, int, int, int, int, const OutputParams*) noexcept;
+// variants: one output plane (dst, dstride) per variant, from one pass over the references.
+using multi_kernel_t = void (*)(uint8_t**, const uint8_t*, const uint8_t**, const uint8_t**, const int*, int, const int*, const int*, int, int, const Variant*, int, const OutputParams*) noexcept;
+using decimate_t = void (*)(uint8_t*, const uint8_t*, int, int, int, int) noexcept;
+// spatial: 3x3 clean-up of the filtered rows (dst, src, dstride, sstride, width, height), the rows around src are read.
+using spatial_t = void (*)(uint8_t*, const uint8_t*, int, int, int, int) noexcept;
+
+// Reduced copy of the processed planes of a source frame: 2x2 averages (fast) or half floats (f16).
+struct HalfFrame
+{
+    std::unique_ptr<uint8_t[]> buff;
+    uint8_t* ptr[3];
+    int pitch[3], width[3], height[3];
+};
+
+// Small ring of the values of the last source frames, keyed by frame number and shared by the threads of the filter.
+// The oldest entry is replaced; the lock is only held to scan the keys and to copy a reference (about 50 ns,
+// against 17 lookups per output frame at strength 8 and milliseconds of filtering: it is rarely contended).
+template <typename V>
+class FrameRing
+{
+    std::mutex mtx;
+    std::vector<std::pair<int, V>> slots;
+    size_t next = 0;
+
+public:
+    void resize(size_t size)
+    {
+        slots.assign(size, { -1, V() });
+        next = 0;
+    }
+
+    bool empty() const { return slots.empty(); }
+
+    bool find(int n, V& v)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& s : slots)
+            if (s.first == n)
+            {
+                v = s.second;
+                return true;
+            }
+        return false;
+    }
+
+    // returns the value of n if another thread stored it first.
+    V insert(int n, V v)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& s : slots)
+            if (s.first == n)
+                return s.second;
+        slots[next] = { n, v };
+        next = (next + 1) % slots.size();
+        return v;
+    }
+};
+
+// Buffers of the reduced copies, reused once the copies leave the ring and their last user:
+// a fresh large allocation costs a page fault per 4 KiB on first touch.
+class BufferPool
+{
+    std::mutex mtx;
+    std::vector<std::unique_ptr<uint8_t[]>> buffers;
+
+public:
+    // all the buffers of a pool have the same size.
+    std::unique_ptr<uint8_t[]> get(size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!buffers.empty())
+            {
+                std::unique_ptr<uint8_t[]> b = std::move(buffers.back());
+                buffers.pop_back();
+                return b;
+            }
+        }
+        return std::unique_ptr<uint8_t[]>(new uint8_t[size]);
+    }
+
+    void put(std::unique_ptr<uint8_t[]> b)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        buffers.push_back(std::move(b));
+    }
+};
+
+// Output frames of a previous run (e.g. the first pass of an encode) in a memory-mapped file (ReduceFlicker_Cache.cpp).
+// Slot n holds the processed planes of output frame n and the key of the source frames it was made from.
+class OutputCache
+{
+    void* file;
+    void* mapping;
+    uint8_t* base;
+    size_t size;
+    size_t slot_size;
+    int num_frames;
+
+public:
+    // The file is reset when it was made with other parameters (params) or for another clip.
+    OutputCache(const char* path, uint64_t params, int num_frames, size_t frame_size);
+    ~OutputCache();
+    bool is_open() const { return base != nullptr; }
+
+    // planes of frame n when its key matches.
+    const uint8_t* find(int n, uint64_t key) const;
+    // planes of frame n to be filled, then commit(n, key).
+    uint8_t* begin_store(int n);
+    void commit(int n, uint64_t key);
+};
+
+// budget: the strength of the next frames (the level, 0: pass-through) from the time taken by the previous ones, shared by the threads.
+// An overrun drops the level one step below the level of the late frame at once. The level goes one step up after 'ramp' frames
+// in a row under half of the budget. The ramp doubles when an overrun follows a raise before a full ramp of headroom,
+// and halves when a raise holds, so a load at the edge of two levels doesn't make the strength oscillate.
+class LevelControl
+{
+    static constexpr int MIN_RAMP = 16;
+    static constexpr int MAX_RAMP = 1024;
+
+    std::atomic<int> current{ 0 };
+    std::atomic<int> calm{ 0 };         // frames in a row under half of the budget
+    std::atomic<int> ramp{ MIN_RAMP };
+    std::atomic<bool> raised{ false };  // the last change was a raise that hasn't held yet
+    int top = 0;
+    double budget = 0.0;
+
+public:
+    void reset(int max_level, double seconds)
+    {
+        top = max_level;
+        budget = seconds;
+        current = max_level;
+        calm = 0;
+        ramp = MIN_RAMP;
+        raised = false;
+    }
+
+    int level() const { return current.load(std::memory_order_relaxed); }
+
+    // a frame made at 'level' took 'seconds'.
+    void update(int level, double seconds)
+    {
+        if (seconds > budget)
+        {
+            calm = 0;
+            if (raised.exchange(false))
+                ramp = min(ramp.load() * 2, MAX_RAMP);
+            int cur = current.load();
+            while (level > 0 && cur >= level && !current.compare_exchange_weak(cur, level - 1)) {}
+        }
+        else if (seconds < budget * 0.5)
+        {
+            if (calm.fetch_add(1) + 1 < ramp.load())
+                return;
+            calm = 0;
+            if (raised.exchange(false))
+                ramp = max(ramp.load() / 2, MIN_RAMP);
+            int cur = level;
+            if (cur < top && current.compare_exchange_strong(cur, cur + 1))
+                raised = true;
+        }
+        else
+            calm = 0;
+    }
+};
+
+uint64_t hash_bytes(uint64_t seed, const uint8_t* p, int pitch, int rowsize, int height) noexcept;
+
+// Profiling of the routines (ReduceFlicker_Profile.cpp): -1 when a counter isn't available.
+struct PerfSample
+{
+    double seconds;
+    int64_t cycles;
+    int64_t instructions;
+    int64_t llc_misses;
+};
+
+// Hardware counters of the calling thread (perf_event_open on Linux, elsewhere only the time).
+class PerfCounters
+{
+    int fd[3];
+    double t0;
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+    void start();
+    PerfSample stop();
+};
+
+double copy_bandwidth();
+
+template <typename T, int STRENGTH, int STORE>
+void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STRENGTH, int STORE>
+void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STORE>
+void proc_r_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STORE>
+void proc_ra_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T>
+void decimate_sse2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template <typename T, int MODE>
+void spatial_sse2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_f_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept;
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_p_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STORE>
+void proc_v_sse2(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept;
+
+template <typename T, int STRENGTH, int STORE>
+void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STRENGTH, int STORE>
+void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STORE>
+void proc_r_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STORE>
+void proc_ra_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T>
+void decimate_avx2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template <typename T, int MODE>
+void spatial_avx2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_f_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept;
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_p_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+template <typename T, int STORE>
+void proc_v_avx2(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept;
+void to_f16_avx2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template <bool AGGRESSIVE, int STORE>
+void proc_h_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+
+// The arguments of ReduceFlicker(), checked and with their defaults resolved by Create_ReduceFlicker.
+struct ReduceFlickerParams
+{
+    int strength, cstrength;        // variants: the widest strength
+    bool aggressive, caggressive;
+    bool grey, luma, raccess;
+    int opt;
+    int bits;       // output bit depth
+    int dither;
+    bool inplace;
+    int first, last, afirst, alast;
+    bool fast;
+    int store;      // -1: from the size of the frames, 0: non-temporal, 1: regular stores
+    bool stats;
+    float skip, weak;
+    PClip mask;
+    int ring;       // -1: the window of a few frames in flight
+    const char* cache;      // path of the output cache, nullptr: none
+    bool f16, causal;
+    int spatial;
+    bool bound;
+    Variant variants[MAX_VARIANTS];
+    int nvariants;
+    float budget;   // milliseconds, 0: no deadline
+};
+
+class ReduceFlicker : public GenericVideoFilter
+{
+    int strength;   // the widest of the processed planes
     bool _grey;
     int opt_;
     size_t align;
     bool raccess, _luma;
+    bool inplace;
+    bool fast;
+    bool f16;       // the references of the bound are read from half float copies
+    bool causal;    // only n and the previous frames are read (no lookahead)
+    int spatial;    // 3x3 clean-up of the output (RemoveGrain mode, 0: none)
+    bool bound;     // the bound of the kernels is attached to the output (ReduceFlickerBound)
+    Variant variants[MAX_VARIANTS];     // variants: the first is the output, the others are attached to it (ReduceFlickerVariant)
+    int nvariants;
+    double budget;      // seconds per frame (0: no deadline), the strength follows qos
+    LevelControl qos;
+    bool stats;
+    float skip, weak;   // adaptive strength: thresholds of the flicker energy (8-bit scale)
+    PClip mask;
+    int mask_last;
     bool processPlane[3];
     bool has_at_least_v8;
     bool avx2, sse2;
+    int in_size;
+    int dither;
+    bool converting;    // the output has another bit depth
+    int nprev;
+    int first, afirst, alast;
+    double in_peak;
+    OutputParams oparams[3];
+
+    int planeStrength[3];
+
+    kernel_t process[3];
+    kernel_t process_row[3];
+    kernel_t process_weak[3];       // strength 1 (adaptive)
+    kernel_t process_weak_row[3];
+    kernel_t process_level[3][MAX_STRENGTH];      // budget: the strengths between 1 and the strength of the plane
+    kernel_t process_level_row[3][MAX_STRENGTH];
+    fast_kernel_t process_fast[3];
+    fast_kernel_t process_fast_row[3];
+    spatial_t process_spatial[3];
+    multi_kernel_t process_multi[3];
+    decimate_t decimate;
+
+    BufferPool half_pool;   // destroyed after half_cache, which returns its buffers
+    BufferPool spatial_pool[3];     // spatial: the strip buffers of each plane
+    FrameRing<std::shared_ptr<const HalfFrame>> half_cache;
+    FrameRing<PVideoFrame> frame_ring;  // source frames, shared by the output frames around them (MT)
+
+    std::unique_ptr<OutputCache> cache;
+    uint64_t cache_params;
+    FrameRing<uint64_t> hash_ring;      // hashes of the source frames
+    size_t cache_offsets[3];            // processed planes in a slot of the cache
+
+    PVideoFrame get_frame(int n, IScriptEnvironment* env);
+    uint64_t get_key(int n, IScriptEnvironment* env);
+    std::shared_ptr<const HalfFrame> get_half(int n, const PVideoFrame& src);
+    PVideoFrame pass_through(PVideoFrame& curr, int level, std::chrono::steady_clock::time_point start, IScriptEnvironment* env);
+
+public:
+    ReduceFlicker(PClip c, const ReduceFlickerParams& p, IScriptEnvironment* env);
+    PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+    bool __stdcall GetParity(int n)
+    {
+        return child->GetParity(first + n);
+    }
+    int __stdcall SetCacheHints(int cachehints, int frame_range)
+    {
+        return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+    }
+};
 
-    void (*process)(uint8_t*, const uint8_t*, const uint8_t**, const uint8_t**, int, int, int*, int*, int, int) noexcept;
+// The bound attached by ReduceFlicker(bound=true) to its frames, as a clip.
+class ReduceFlickerBound : public GenericVideoFilter
+{
+public:
+    ReduceFlickerBound(PClip c) : GenericVideoFilter(c) {}
+    PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+    int __stdcall SetCacheHints(int cachehints, int frame_range)
+    {
+        return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+    }
+};
+
+// One of the outputs of ReduceFlicker(variants=...), as a clip (0: the clip itself).
+class ReduceFlickerVariant : public GenericVideoFilter
+{
+    int index;
 
 public:
-    ReduceFlicker(PClip c, int str, bool agr, bool grey, int opt, bool raccess, bool luma, IScriptEnvironment* env);
+    ReduceFlickerVariant(PClip c, int i) : GenericVideoFilter(c), index(i) {}
     PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
     int __stdcall SetCacheHints(int cachehints, int frame_range)
     {
@@ -0,0 +1,81 @@
+/*
+ReduceFlicker_API.h
+
+This file is a part of ReduceFlicker.
+
+C interface of the routines for planes held in memory, without AviSynth.
+python/reduceflicker.py uses it through ctypes.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef REDUCEFLICKER_EXPORTS
+#ifdef _WIN32
+#define REDUCEFLICKER_API __declspec(dllexport)
+#else
+#define REDUCEFLICKER_API __attribute__((visibility("default")))
+#endif
+#elif defined(_WIN32)
+#define REDUCEFLICKER_API __declspec(dllimport)
+#else
+#define REDUCEFLICKER_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Filters the frames first..last of a sequence of num_frames planes of the same size and sample type.
+src[k]: first row of frame k, dst[n - first]: first row of the output of frame n, pitches in bytes.
+The output must not overlap the source frames.
+bits: 8 (uint8_t), 9..16 (uint16_t) or 32 (float). opt: -1 (auto), 0 (C), 1 (SSE2), 2 (AVX2).
+The AVX2 float routine also needs FMA3 (SSE2 otherwise). The float routines run with denormals flushed to zero.
+The neighbours are clamped to 0..num_frames - 1, so that consecutive ranges join like segments.
+Returns 0, or -1 when a parameter is invalid.
+*/
+REDUCEFLICKER_API int ReduceFlicker_Process(uint8_t* const* dst, const int* dpitch, const uint8_t* const* src, const int* spitch, int num_frames, int first, int last, int width, int height, int bits, int strength, int aggressive, int opt);
+
+/* A sequence of planes of ReduceFlicker_ProcessBatch, same fields as the parameters of ReduceFlicker_Process. */
+typedef struct ReduceFlickerStream
+{
+    uint8_t* const* dst;
+    const int* dpitch;
+    const uint8_t* const* src;
+    const int* spitch;
+    int num_frames, first, last;
+    int width, height, bits;
+    int strength, aggressive;
+} ReduceFlickerStream;
+
+/*
+Filters many streams (e.g. the planes of many short clips) with one pool of threads (0: one per core).
+The frames of all the streams are the jobs of the pool, so small streams keep all the threads busy.
+Returns 0, or -1 when a stream is invalid (then nothing is processed).
+*/
+REDUCEFLICKER_API int ReduceFlicker_ProcessBatch(const ReduceFlickerStream* streams, int num_streams, int threads, int opt);
+
+/*
+Filters a whole file into dst_path (created, or overwritten), in the same format. The source is either raw planar frames
+(.yuv: the Y, U and V planes of each frame one after the other, width x height, chroma 420, 422, 444 or 400,
+bits 8, 9..16 (little-endian uint16_t) or 32 (float)), or YUV4MPEG2 (.y4m, 8..16-bit), whose header gives the format
+(width, height, chroma and bits are then ignored). Both files are mapped in memory: the planes of the window are read
+in place and the output is written in place, with one pool of threads (0: one per core).
+Returns 0, or -1 when a parameter is invalid, a file can't be mapped or the source isn't a whole number of frames.
+*/
+REDUCEFLICKER_API int ReduceFlicker_ProcessFile(const char* src_path, const char* dst_path, int width, int height, int chroma, int bits, int strength, int aggressive, int threads, int opt);
+
+/*
+Measures the routines on num_frames synthetic planes of width x height: 8, 10, 16 and 32-bit samples, strength 1..8
+(or only strength when it isn't 0), both modes, non-temporal and regular stores, with the isa of opt (-1: all the supported ones).
+Writes a table to path (NULL: stdout): time, cycles, instructions, last level cache misses and memory traffic per pixel,
+against the bandwidth of a large copy. The hardware counters need Linux (perf_event_open), elsewhere only the time is given.
+Returns 0, or -1 when a parameter is invalid, the file can't be written or the frames can't be allocated.
+*/
+REDUCEFLICKER_API int ReduceFlicker_Profile(int width, int height, int num_frames, int strength, int opt, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
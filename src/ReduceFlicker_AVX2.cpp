@@ -1,19 +1,46 @@
-#include <immintrin.h>
-
 #include "ReduceFlicker.h"
 
+#if REDUCEFLICKER_X86
+#include <immintrin.h>
+
 /********************* LOAD ****************************************/
+// Unaligned loads and regular stores: with VEX they are as fast as the aligned ones on aligned rows (and still folded
+// into the operations), so the planes of a mapped file (ReduceFlicker_ProcessFile) needn't be aligned.
+// Only the non-temporal stores need an aligned destination. SSE2 keeps aligned loads, which can be folded.
 template <typename V> static F_INLINE V load(const uint8_t* p);
 
 template <>
 F_INLINE __m256i load(const uint8_t* p)
 {
-    return _mm256_load_si256(reinterpret_cast<const __m256i*>(p));
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
 }
 template <>
 F_INLINE __m256 load(const uint8_t* p)
 {
-    return _mm256_load_ps(reinterpret_cast<const float*>(p));
+    return _mm256_loadu_ps(reinterpret_cast<const float*>(p));
+}
+
+/********************* LOAD HALF ***********************************/
+// fast mode: loads half a register of the half resolution bound and repeats each value twice.
+template <typename T, typename V> static F_INLINE V load_half(const uint8_t* p);
+
+template <>
+F_INLINE __m256i load_half<uint8_t, __m256i>(const uint8_t* p)
+{
+    const __m256i t = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return _mm256_or_si256(t, _mm256_slli_epi16(t, 8));
+}
+template <>
+F_INLINE __m256i load_half<uint16_t, __m256i>(const uint8_t* p)
+{
+    const __m256i t = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return _mm256_or_si256(t, _mm256_slli_epi32(t, 16));
+}
+template <>
+F_INLINE __m256 load_half<float, __m256>(const uint8_t* p)
+{
+    const __m256 t = _mm256_castps128_ps256(_mm_loadu_ps(reinterpret_cast<const float*>(p)));
+    return _mm256_permutevar8x32_ps(t, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
 }
 
 /********************* STORE *************************************/
@@ -27,6 +54,16 @@ static F_INLINE void stream(uint8_t* p, const __m256& x)
     _mm256_stream_ps(reinterpret_cast<float*>(p), x);
 }
 
+static F_INLINE void store(uint8_t* p, const __m256i& x)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x);
+}
+
+static F_INLINE void store(uint8_t* p, const __m256& x)
+{
+    _mm256_storeu_ps(reinterpret_cast<float*>(p), x);
+}
+
 /************************ SETZERO *********************************/
 template <typename V> static F_INLINE V setzero();
 
@@ -218,8 +255,8 @@ template <>
 F_INLINE __m256
 get_avg<float, __m256>(const __m256& a, const __m256& b, const __m256& x, const __m256& q)
 {
-    __m256 t = _mm256_add_ps(_mm256_add_ps(a, b), _mm256_add_ps(x, x));
-    return _mm256_mul_ps(t, q);
+    // (a + b) * 0.25 + x * 0.5: one rounding less than the sum of the four terms (FMA3 is checked with AVX2 for float).
+    return _mm256_fmadd_ps(_mm256_add_ps(a, b), q, _mm256_mul_ps(x, _mm256_add_ps(q, q)));
 }
 
 /****************************** BLENDV *************************/
@@ -235,8 +272,208 @@ blendv(const __m256i& x, const __m256i& y, const __m256i& mask)
     return _mm256_blendv_epi8(x, y, mask);
 }
 
-template <typename T, int STRENGTH>
-void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept
+/****************************** OUTPUT *************************/
+template <typename T, int STORE>
+class Output
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+
+    static constexpr int MODE = store_mode(STORE);
+    static constexpr bool STATS = (STORE & STORE_STATS) != 0;
+    static constexpr bool BOUND = (STORE & STORE_BOUND) != 0;
+    using S = std::conditional_t<std::is_integral_v<T>, int64_t, double>;
+
+    const OutputParams* op;
+    V offs, peak, scale;
+    __m128i shift;
+    // STATS: the sums of the current row are kept in the registers and added to the sums of the plane by flush().
+    int width;
+    V sdiff, stdiff;
+    __m256i sclamped;
+    S diff, tdiff;
+    int64_t clamped;
+    // BOUND: the current row of the bound plane.
+    uint8_t* brow;
+
+    template <typename L, typename A, typename R>
+    static F_INLINE void add_lanes(A& sum, R& reg) noexcept
+    {
+        alignas(32) L t[sizeof(R) / sizeof(L)];
+        store(reinterpret_cast<uint8_t*>(t), reg);
+        for (const L l : t)
+            sum += l;
+        reg = setzero<R>();
+    }
+
+    F_INLINE void flush() noexcept
+    {
+        if constexpr (std::is_same_v<T, uint8_t>)
+        {
+            add_lanes<int64_t>(diff, sdiff);
+            add_lanes<int64_t>(tdiff, stdiff);
+            add_lanes<int64_t>(clamped, sclamped);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            add_lanes<uint32_t>(diff, sdiff);
+            add_lanes<uint32_t>(tdiff, stdiff);
+            add_lanes<uint16_t>(clamped, sclamped);
+        }
+        else
+        {
+            add_lanes<float>(diff, sdiff);
+            add_lanes<float>(tdiff, stdiff);
+            add_lanes<int32_t>(clamped, sclamped);
+        }
+    }
+
+    // lanes of the padding at the right of the plane are not counted.
+    F_INLINE V tail_mask(int x) const noexcept
+    {
+        alignas(32) static constexpr uint8_t table[sizeof(V) * 2] = {
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        };
+        const __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table + sizeof(V) - min(width - x, static_cast<int>(sizeof(V)))));
+        if constexpr (std::is_integral_v<T>)
+            return m;
+        else
+            return _mm256_castsi256_ps(m);
+    }
+
+    F_INLINE void accumulate(int x, const V& val, const V& cur, const V& avg, const V& prv) noexcept
+    {
+        const V m = tail_mask(x);
+        const V d = and_reg(m, abs_diff<T, V>(val, cur));
+        const V t = and_reg(m, abs_diff<T, V>(cur, prv));
+        const V ne = andnot_reg(cmpeq<T>(val, avg), m);
+        if constexpr (std::is_same_v<T, uint8_t>)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            sdiff = _mm256_add_epi64(sdiff, _mm256_sad_epu8(d, zero));
+            stdiff = _mm256_add_epi64(stdiff, _mm256_sad_epu8(t, zero));
+            sclamped = _mm256_add_epi64(sclamped, _mm256_sad_epu8(_mm256_and_si256(ne, _mm256_set1_epi8(1)), zero));
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            sdiff = _mm256_add_epi32(sdiff, _mm256_add_epi32(_mm256_unpacklo_epi16(d, zero), _mm256_unpackhi_epi16(d, zero)));
+            stdiff = _mm256_add_epi32(stdiff, _mm256_add_epi32(_mm256_unpacklo_epi16(t, zero), _mm256_unpackhi_epi16(t, zero)));
+            sclamped = _mm256_sub_epi16(sclamped, ne);
+        }
+        else
+        {
+            sdiff = _mm256_add_ps(sdiff, d);
+            stdiff = _mm256_add_ps(stdiff, t);
+            sclamped = _mm256_sub_epi32(sclamped, _mm256_castps_si256(ne));
+        }
+    }
+
+public:
+    Output(const OutputParams* p, int w) noexcept : op(p), width(w)
+    {
+        if constexpr (STATS)
+        {
+            sdiff = stdiff = setzero<V>();
+            sclamped = setzero<__m256i>();
+            diff = tdiff = 0;
+            clamped = 0;
+        }
+        if constexpr (MODE == STORE_TO8 || MODE == STORE_TO16)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                peak = _mm256_set1_epi16(static_cast<int16_t>(op->peak));
+                shift = _mm_cvtsi32_si128(op->shift);
+            }
+            else
+            {
+                peak = _mm256_set1_ps(static_cast<float>(op->peak));
+                scale = _mm256_set1_ps(op->scale);
+            }
+        }
+    }
+
+    ~Output()
+    {
+        if constexpr (STATS)
+        {
+            flush();
+            op->stats->diff += static_cast<double>(diff);
+            op->stats->tdiff += static_cast<double>(tdiff);
+            op->stats->clamped += clamped;
+        }
+    }
+
+    F_INLINE void set_row(int y) noexcept
+    {
+        if constexpr (STATS)
+            flush();
+        if constexpr (BOUND)
+            brow = op->bound + static_cast<size_t>(op->bstride) * y;
+        if constexpr (MODE == STORE_TO8 || MODE == STORE_TO16)
+        {
+            if constexpr (std::is_integral_v<T>)
+                offs = load<__m256i>(reinterpret_cast<const uint8_t*>(op->ioffs[y & 7]));
+            else
+                offs = load<__m256>(reinterpret_cast<const uint8_t*>(op->foffs[y & 7]));
+        }
+    }
+
+    // the bound of the pixels at x, max(d1, d2) when aggressive (the bounds are equal otherwise).
+    F_INLINE void bound(int x, const V& d1, const V& d2) noexcept
+    {
+        if constexpr (BOUND)
+            store(brow + x, max<T>(d1, d2));
+    }
+
+    F_INLINE void operator()(uint8_t* dstp, int x, const V& val, const V& cur, const V& avg, const V& prv) noexcept
+    {
+        if constexpr (STATS)
+            accumulate(x, val, cur, avg, prv);
+
+        if constexpr (MODE == STORE_STREAM)
+        {
+            stream(dstp + x, val);
+        }
+        else if constexpr (MODE == STORE_CACHED)
+        {
+            store(dstp + x, val);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            const __m256i t = _mm256_srl_epi16(_mm256_adds_epu16(val, offs), shift);
+            if constexpr (MODE == STORE_TO8)
+            {
+                const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(t, t), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_store_si128(reinterpret_cast<__m128i*>(dstp + x / 2), _mm256_castsi256_si128(p));
+            }
+            else
+            {
+                stream(dstp + x, _mm256_min_epu16(t, peak));
+            }
+        }
+        else
+        {
+            const __m256 t = _mm256_fmadd_ps(val, scale, offs);
+            const __m256i i = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), peak));
+            if constexpr (MODE == STORE_TO8)
+            {
+                const __m256i w = _mm256_packs_epi32(i, i);
+                const __m256i p = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(w, w), _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp + x / 4), _mm256_castsi256_si128(p));
+            }
+            else
+            {
+                const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(i, i), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_store_si128(reinterpret_cast<__m128i*>(dstp + x / 2), _mm256_castsi256_si128(p));
+            }
+        }
+    }
+};
+
+template <typename T, int STRENGTH, int STORE>
+void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
 {
     using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
 
@@ -257,9 +494,11 @@ void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const
     width *= sizeof(T);
 
     V q = set1<T, V>();
+    Output<T, STORE> out(op, width);
 
     for (int y = 0; y < height; ++y)
     {
+        out.set_row(y);
         for (int x = 0; x < width; x += sizeof(V))
         {
             const V curx = load<V>(currp + x);
@@ -278,7 +517,8 @@ void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const
             const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d), curx);
             const V ll = min<T>(add<T>(max<T>(pr0, nx0), d), curx);
             const V avg = get_avg<T, V>(pr0, nx0, curx, q);
-            stream(dstp + x, clamp<T, V>(avg, ll, ul));
+            out.bound(x, d, d);
+            out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
         }
         prv0 += pstride[0];
         prv1 += pstride[1];
@@ -297,18 +537,6 @@ void proc_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const
     }
 }
 
-template void proc_avx2<uint8_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_avx2<uint16_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_avx2<float, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-
-template void proc_avx2<uint8_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_avx2<uint16_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_avx2<float, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-
-template void proc_avx2<uint8_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_avx2<uint16_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_avx2<float, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-
 template <typename T, typename V>
 static F_INLINE void
 update_diff(const V& x, const V& y, V& d1, V& d2, const V& zero)
@@ -320,8 +548,8 @@ update_diff(const V& x, const V& y, V& d1, V& d2, const V& zero)
     d2 = blendv(min<T>(d, d2), zero, mask);
 }
 
-template <typename T, int STRENGTH>
-void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept
+template <typename T, int STRENGTH, int STORE>
+void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
 {
     using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
 
@@ -342,10 +570,12 @@ void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, con
     width *= sizeof(T);
 
     V q = set1<T, V>();
+    Output<T, STORE> out(op, width);
     V zero = setzero<V>();
 
     for (int y = 0; y < height; ++y)
     {
+        out.set_row(y);
         for (int x = 0; x < width; x += sizeof(V))
         {
             const V curx = load<V>(currp + x);
@@ -369,7 +599,8 @@ void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, con
             const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d1), curx);
             const V ll = min<T>(add<T>(max<T>(pr0, nx0), d2), curx);
             const V avg = get_avg<T, V>(pr0, nx0, curx, q);
-            stream(dstp + x, clamp<T, V>(avg, ll, ul));
+            out.bound(x, d1, d2);
+            out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
         }
         prv0 += pstride[0];
         prv1 += pstride[1];
@@ -389,14 +620,721 @@ void proc_a_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, con
 
 }
 
-template void proc_a_avx2<uint8_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_avx2<uint16_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_avx2<float, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+// Runtime strength (> 3). The bound of a block of pixels is accumulated one reference frame at a time,
+// so the number of references does not change the working set of the inner loops.
+constexpr int BLOCK_SIZE = 2048;
+
+template <typename T, int STORE>
+void proc_r_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    const int nrefs = strength * 2 - 2;
+    for (int k = 1; k < strength; ++k)
+    {
+        refp[k * 2 - 2] = prevp[k];
+        rstride[k * 2 - 2] = pstride[k];
+        refp[k * 2 - 1] = nextp[k];
+        rstride[k * 2 - 1] = nstride[k];
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    Output<T, STORE> out(op, width);
+    V dbuf[BLOCK_SIZE / sizeof(V)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0; x < x1; x += sizeof(V))
+                dbuf[(x - x0) / sizeof(V)] = abs_diff<T, V>(load<V>(currp + x), load<V>(refp[0] + x));
+            for (int k = 1; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                for (int x = x0; x < x1; x += sizeof(V))
+                    dbuf[(x - x0) / sizeof(V)] = min<T>(dbuf[(x - x0) / sizeof(V)], abs_diff<T, V>(load<V>(currp + x), load<V>(r + x)));
+            }
+
+            for (int x = x0; x < x1; x += sizeof(V))
+            {
+                const V curx = load<V>(currp + x);
+                const V pr0 = load<V>(prv0 + x);
+                const V nx0 = load<V>(nxt0 + x);
+                const V ul = max<T>(sub<T>(min<T>(pr0, nx0), dbuf[(x - x0) / sizeof(V)]), curx);
+                const V ll = min<T>(add<T>(max<T>(pr0, nx0), dbuf[(x - x0) / sizeof(V)]), curx);
+                const V avg = get_avg<T, V>(pr0, nx0, curx, q);
+                out.bound(x, dbuf[(x - x0) / sizeof(V)], dbuf[(x - x0) / sizeof(V)]);
+                out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+template <typename T, int STORE>
+void proc_ra_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    const int nrefs = strength * 2 - 2;
+    for (int k = 1; k < strength; ++k)
+    {
+        refp[k * 2 - 2] = prevp[k];
+        rstride[k * 2 - 2] = pstride[k];
+        refp[k * 2 - 1] = nextp[k];
+        rstride[k * 2 - 1] = nstride[k];
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+    V d1buf[BLOCK_SIZE / sizeof(V)], d2buf[BLOCK_SIZE / sizeof(V)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0; x < x1; x += sizeof(V))
+            {
+                const V curx = load<V>(currp + x);
+                V t0 = load<V>(refp[0] + x);
+                V t1 = max<T>(t0, curx);
+                V t2 = cmpeq<T>(t0, t1);
+                t0 = sub<T>(t1, min<T>(t0, curx));
+                d1buf[(x - x0) / sizeof(V)] = and_reg(t2, t0);
+                d2buf[(x - x0) / sizeof(V)] = andnot_reg(t2, t0);
+            }
+            for (int k = 1; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                for (int x = x0; x < x1; x += sizeof(V))
+                    update_diff<T, V>(load<V>(r + x), load<V>(currp + x), d1buf[(x - x0) / sizeof(V)], d2buf[(x - x0) / sizeof(V)], zero);
+            }
+
+            for (int x = x0; x < x1; x += sizeof(V))
+            {
+                const V curx = load<V>(currp + x);
+                const V pr0 = load<V>(prv0 + x);
+                const V nx0 = load<V>(nxt0 + x);
+                const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d1buf[(x - x0) / sizeof(V)]), curx);
+                const V ll = min<T>(add<T>(max<T>(pr0, nx0), d2buf[(x - x0) / sizeof(V)]), curx);
+                const V avg = get_avg<T, V>(pr0, nx0, curx, q);
+                out.bound(x, d1buf[(x - x0) / sizeof(V)], d2buf[(x - x0) / sizeof(V)]);
+                out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+// fast mode: 2x2 average (same rounding as decimate_c), 32 bytes of two rows to 16 bytes.
+template <typename T>
+void decimate_avx2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    const int hheight = (height + 1) / 2;
+    const int bwidth = width * static_cast<int>(sizeof(T));
+
+    for (int y = 0; y < hheight; ++y)
+    {
+        uint8_t* dst = dstp + static_cast<size_t>(dstride) * y;
+        const uint8_t* s0 = srcp + static_cast<size_t>(sstride) * y * 2;
+        const uint8_t* s1 = srcp + static_cast<size_t>(sstride) * min(y * 2 + 1, height - 1);
+
+        for (int x = 0; x < bwidth; x += 32)
+        {
+            __m128i res;
+            if constexpr (std::is_same_v<T, uint8_t>)
+            {
+                const __m256i r0 = load<__m256i>(s0 + x);
+                const __m256i r1 = load<__m256i>(s1 + x);
+                const __m256i mask = _mm256_set1_epi16(0x00FF);
+                __m256i t = _mm256_add_epi16(_mm256_and_si256(r0, mask), _mm256_srli_epi16(r0, 8));
+                t = _mm256_add_epi16(t, _mm256_add_epi16(_mm256_and_si256(r1, mask), _mm256_srli_epi16(r1, 8)));
+                t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_set1_epi16(2)), 2);
+                res = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(t, t), _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            else if constexpr (std::is_same_v<T, uint16_t>)
+            {
+                const __m256i r0 = load<__m256i>(s0 + x);
+                const __m256i r1 = load<__m256i>(s1 + x);
+                const __m256i mask = _mm256_set1_epi32(0xFFFF);
+                __m256i t = _mm256_add_epi32(_mm256_and_si256(r0, mask), _mm256_srli_epi32(r0, 16));
+                t = _mm256_add_epi32(t, _mm256_add_epi32(_mm256_and_si256(r1, mask), _mm256_srli_epi32(r1, 16)));
+                t = _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_set1_epi32(2)), 2);
+                res = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(t, t), _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            else
+            {
+                const __m256 t = _mm256_add_ps(load<__m256>(s0 + x), load<__m256>(s1 + x));
+                const __m256 e = _mm256_shuffle_ps(t, t, _MM_SHUFFLE(2, 0, 2, 0));
+                const __m256 o = _mm256_shuffle_ps(t, t, _MM_SHUFFLE(3, 1, 3, 1));
+                const __m256 a = _mm256_mul_ps(_mm256_add_ps(e, o), _mm256_set1_ps(0.25f));
+                res = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_castps_si256(a), _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x / 2), res);
+        }
+
+        if (width & 1)
+        {
+            const T a = reinterpret_cast<const T*>(s0)[width - 1];
+            const T b = reinterpret_cast<const T*>(s1)[width - 1];
+            if constexpr (std::is_integral_v<T>)
+                reinterpret_cast<T*>(dst)[width / 2] = static_cast<T>((a + a + b + b + 2) >> 2);
+            else
+                reinterpret_cast<T*>(dst)[width / 2] = ((a + b) + (a + b)) * 0.25f;
+        }
+    }
+}
+
+template <typename T, typename V>
+static F_INLINE void sort_pair(V& a, V& b)
+{
+    const V t = min<T>(a, b);
+    b = max<T>(a, b);
+    a = t;
+}
+
+// The center clipped to the MODE-th smallest and largest of its 8 neighbours (same network as spatial_c).
+template <typename T, int MODE, typename V>
+static F_INLINE V spatial_clip(const V& c, V* a)
+{
+    if constexpr (MODE == 1)
+    {
+        const V lo = min<T>(min<T>(min<T>(a[0], a[1]), min<T>(a[2], a[3])), min<T>(min<T>(a[4], a[5]), min<T>(a[6], a[7])));
+        const V hi = max<T>(max<T>(max<T>(a[0], a[1]), max<T>(a[2], a[3])), max<T>(max<T>(a[4], a[5]), max<T>(a[6], a[7])));
+        return clamp<T>(c, lo, hi);
+    }
+    else
+    {
+        sort_pair<T>(a[0], a[1]); sort_pair<T>(a[2], a[3]); sort_pair<T>(a[4], a[5]); sort_pair<T>(a[6], a[7]);
+        sort_pair<T>(a[0], a[2]); sort_pair<T>(a[1], a[3]); sort_pair<T>(a[4], a[6]); sort_pair<T>(a[5], a[7]);
+        sort_pair<T>(a[1], a[2]); sort_pair<T>(a[5], a[6]);
+        sort_pair<T>(a[0], a[4]); sort_pair<T>(a[1], a[5]); sort_pair<T>(a[2], a[6]); sort_pair<T>(a[3], a[7]);
+        sort_pair<T>(a[2], a[4]); sort_pair<T>(a[3], a[5]);
+        sort_pair<T>(a[1], a[2]); sort_pair<T>(a[3], a[4]); sort_pair<T>(a[5], a[6]);
+        return clamp<T>(c, a[MODE - 1], a[8 - MODE]);
+    }
+}
+
+// spatial: the whole row is processed by registers from column 0 (the sample before the row and the padding are read),
+// then the first and the last columns are restored.
+template <typename T, int MODE>
+void spatial_avx2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+    constexpr int s = sizeof(T);
+    const int bwidth = width * s;
+
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t* dst = dstp + static_cast<size_t>(dstride) * y;
+        const uint8_t* s1 = srcp + static_cast<ptrdiff_t>(sstride) * y;
+        const uint8_t* s0 = s1 - sstride;
+        const uint8_t* s2 = s1 + sstride;
+
+        for (int x = 0; x < bwidth; x += 32)
+        {
+            V a[8] = {
+                load<V>(s0 + x - s), load<V>(s0 + x), load<V>(s0 + x + s),
+                load<V>(s1 + x - s), load<V>(s1 + x + s),
+                load<V>(s2 + x - s), load<V>(s2 + x), load<V>(s2 + x + s),
+            };
+            store(dst + x, spatial_clip<T, MODE>(load<V>(s1 + x), a));
+        }
+
+        reinterpret_cast<T*>(dst)[0] = reinterpret_cast<const T*>(s1)[0];
+        reinterpret_cast<T*>(dst)[width - 1] = reinterpret_cast<const T*>(s1)[width - 1];
+    }
+}
+
+// fast mode: the bound of a block of a half resolution row is computed once and used for two rows.
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_f_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    for (int k = 0; k < nrefs; ++k)
+        refp[k] = hrefp[k];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+    V d1buf[BLOCK_SIZE / 2 / sizeof(V)], d2buf[BLOCK_SIZE / 2 / sizeof(V)];
+
+    for (int y = 0; y < height; y += 2)
+    {
+        const int rows = min(height - y, 2);
+
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0 / 2; x < (x1 + 1) / 2; x += sizeof(V))
+            {
+                const V curx = load<V>(hcurrp + x);
+                V t0 = load<V>(refp[0] + x);
+                if constexpr (!AGGRESSIVE)
+                {
+                    V d = abs_diff<T, V>(curx, t0);
+                    for (int k = 1; k < nrefs; ++k)
+                        d = min<T>(d, abs_diff<T, V>(curx, load<V>(refp[k] + x)));
+                    d1buf[(x - x0 / 2) / sizeof(V)] = d;
+                }
+                else
+                {
+                    V t1 = max<T>(t0, curx);
+                    V t2 = cmpeq<T>(t0, t1);
+                    t0 = sub<T>(t1, min<T>(t0, curx));
+                    V d1 = and_reg(t2, t0);
+                    V d2 = andnot_reg(t2, t0);
+                    for (int k = 1; k < nrefs; ++k)
+                        update_diff<T, V>(load<V>(refp[k] + x), curx, d1, d2, zero);
+                    d1buf[(x - x0 / 2) / sizeof(V)] = d1;
+                    d2buf[(x - x0 / 2) / sizeof(V)] = d2;
+                }
+            }
+
+            const uint8_t* d1p = reinterpret_cast<const uint8_t*>(d1buf);
+            const uint8_t* d2p = AGGRESSIVE ? reinterpret_cast<const uint8_t*>(d2buf) : d1p;
+
+            for (int r = 0; r < rows; ++r)
+            {
+                const uint8_t* cur = currp + static_cast<size_t>(cstride) * r;
+                const uint8_t* prv0 = prevp + static_cast<size_t>(pstride) * r;
+                const uint8_t* nxt0 = nextp + static_cast<size_t>(nstride) * r;
+                uint8_t* dst = dstp + static_cast<size_t>(dstride) * r;
+                out.set_row(y + r);
+                for (int x = x0; x < x1; x += sizeof(V))
+                {
+                    const V curx = load<V>(cur + x);
+                    const V pr0 = load<V>(prv0 + x);
+                    const V nx0 = load<V>(nxt0 + x);
+                    const V d1 = load_half<T, V>(d1p + (x - x0) / 2);
+                    const V d2 = load_half<T, V>(d2p + (x - x0) / 2);
+                    const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d1), curx);
+                    const V ll = min<T>(add<T>(max<T>(pr0, nx0), d2), curx);
+                    const V avg = get_avg<T, V>(pr0, nx0, curx, q);
+                    out.bound(x, d1, d2);
+                    out(dst, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+                }
+            }
+        }
+        prevp += static_cast<size_t>(pstride) * 2;
+        nextp += static_cast<size_t>(nstride) * 2;
+        currp += static_cast<size_t>(cstride) * 2;
+        dstp += static_cast<size_t>(dstride) * 2;
+        hcurrp += hstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += hstride;
+    }
+}
+
+// f16: half float copy of a float plane (rounded to nearest), 8 samples at a time.
+void to_f16_avx2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; x += 8)
+            _mm_store_si128(reinterpret_cast<__m128i*>(dstp + x * 2), _mm256_cvtps_ph(load<__m256>(srcp + x * 4), _MM_FROUND_TO_NEAREST_INT));
+        dstp += dstride;
+        srcp += sstride;
+    }
+}
+
+static F_INLINE __m256 load_f16(const uint8_t* p)
+{
+    return _mm256_cvtph_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// f16: the references of the bound (prevp[1..], nextp[1..]) are half float copies, so they cost half the bandwidth.
+// The current frame and the nearest neighbours (average and clamp) are read at full precision. Runtime strength.
+template <bool AGGRESSIVE, int STORE>
+void proc_h_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    int nrefs = 0;
+    for (int k = 1; k < max(strength, 2); ++k)
+    {
+        refp[nrefs] = prevp[k];
+        rstride[nrefs++] = pstride[k];
+    }
+    for (int k = 1; k < strength; ++k)
+    {
+        refp[nrefs] = nextp[k];
+        rstride[nrefs++] = nstride[k];
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+
+    width *= sizeof(float);
+
+    __m256 q = set1<float, __m256>();
+    __m256 zero = setzero<__m256>();
+    Output<float, STORE> out(op, width);
+    __m256 d1buf[BLOCK_SIZE / sizeof(__m256)], d2buf[BLOCK_SIZE / sizeof(__m256)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0; x < x1; x += sizeof(__m256))
+            {
+                const __m256 curx = load<__m256>(currp + x);
+                __m256 t0 = load_f16(refp[0] + x / 2);
+                if constexpr (!AGGRESSIVE)
+                {
+                    d1buf[(x - x0) / sizeof(__m256)] = abs_diff<float, __m256>(curx, t0);
+                }
+                else
+                {
+                    __m256 t1 = max<float>(t0, curx);
+                    __m256 t2 = cmpeq<float>(t0, t1);
+                    t0 = sub<float>(t1, min<float>(t0, curx));
+                    d1buf[(x - x0) / sizeof(__m256)] = and_reg(t2, t0);
+                    d2buf[(x - x0) / sizeof(__m256)] = andnot_reg(t2, t0);
+                }
+            }
+            for (int k = 1; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                for (int x = x0; x < x1; x += sizeof(__m256))
+                {
+                    if constexpr (!AGGRESSIVE)
+                        d1buf[(x - x0) / sizeof(__m256)] = min<float>(d1buf[(x - x0) / sizeof(__m256)], abs_diff<float, __m256>(load<__m256>(currp + x), load_f16(r + x / 2)));
+                    else
+                        update_diff<float, __m256>(load_f16(r + x / 2), load<__m256>(currp + x), d1buf[(x - x0) / sizeof(__m256)], d2buf[(x - x0) / sizeof(__m256)], zero);
+                }
+            }
+
+            const __m256* d2p = AGGRESSIVE ? d2buf : d1buf;
+            for (int x = x0; x < x1; x += sizeof(__m256))
+            {
+                const __m256 curx = load<__m256>(currp + x);
+                const __m256 pr0 = load<__m256>(prv0 + x);
+                const __m256 nx0 = load<__m256>(nxt0 + x);
+                const __m256 ul = max<float>(sub<float>(min<float>(pr0, nx0), d1buf[(x - x0) / sizeof(__m256)]), curx);
+                const __m256 ll = min<float>(add<float>(max<float>(pr0, nx0), d2p[(x - x0) / sizeof(__m256)]), curx);
+                const __m256 avg = get_avg<float, __m256>(pr0, nx0, curx, q);
+                out.bound(x, d1buf[(x - x0) / sizeof(__m256)], d2p[(x - x0) / sizeof(__m256)]);
+                out(dstp, x, clamp<float, __m256>(avg, ll, ul), curx, avg, pr0);
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+// causal mode: only the previous frames are read (n - max(strength, 2) .. n). The average and the clamp use n - 1,
+// the bound the frames before it: the symmetric routines with the next frames replaced by the previous ones.
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_p_avx2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+
+    const uint8_t* refp[MAX_STRENGTH];
+    const int nrefs = max(strength, 2) - 1;
+    for (int k = 0; k < nrefs; ++k)
+        refp[k] = prevp[k + 1];
+    const uint8_t* prv0 = prevp[0];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x = 0; x < width; x += sizeof(V))
+        {
+            const V curx = load<V>(currp + x);
+            V t0 = load<V>(refp[0] + x);
+            V d1, d2;
+            if constexpr (!AGGRESSIVE)
+            {
+                d1 = abs_diff<T, V>(curx, t0);
+                for (int k = 1; k < nrefs; ++k)
+                    d1 = min<T>(d1, abs_diff<T, V>(curx, load<V>(refp[k] + x)));
+                d2 = d1;
+            }
+            else
+            {
+                V t1 = max<T>(t0, curx);
+                V t2 = cmpeq<T>(t0, t1);
+                t0 = sub<T>(t1, min<T>(t0, curx));
+                d1 = and_reg(t2, t0);
+                d2 = andnot_reg(t2, t0);
+                for (int k = 1; k < nrefs; ++k)
+                    update_diff<T, V>(load<V>(refp[k] + x), curx, d1, d2, zero);
+            }
+            const V pr0 = load<V>(prv0 + x);
+            const V ul = max<T>(sub<T>(pr0, d1), curx);
+            const V ll = min<T>(add<T>(pr0, d2), curx);
+            const V avg = get_avg<T, V>(pr0, pr0, curx, q);
+            out.bound(x, d1, d2);
+            out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+        }
+        prv0 += pstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += pstride[k + 1];
+    }
+}
+
+// variants: the bounds of a block are built in the order of the strengths (n - 2, n + 2, then n - s and n + s),
+// each variant is written once the references of its strength are in: every reference row is read once for all of them.
+// The average and the min/max of n - 1 and n + 1 are kept with the first reference, a variant only adds its bound and clamps.
+template <typename T, int STORE>
+void proc_v_avx2(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m256i, __m256>;
+
+    int strength = 1;
+    bool plain = false, aggressive = false;
+    for (int v = 0; v < nvariants; ++v)
+    {
+        strength = max(strength, variants[v].strength);
+        plain |= !variants[v].aggressive;
+        aggressive |= variants[v].aggressive;
+    }
+
+    // the references in the order of the strengths.
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    int nrefs = 0;
+    for (int k = 1; k < max(strength, 2); ++k)
+    {
+        refp[nrefs] = prevp[k];
+        rstride[nrefs++] = pstride[k];
+        if (k < strength)
+        {
+            refp[nrefs] = nextp[k];
+            rstride[nrefs++] = nstride[k];
+        }
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+    uint8_t* dst[MAX_VARIANTS];
+    for (int v = 0; v < nvariants; ++v)
+        dst[v] = dstp[v];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+    V dbuf[BLOCK_SIZE / sizeof(V)], d1buf[BLOCK_SIZE / sizeof(V)], d2buf[BLOCK_SIZE / sizeof(V)];
+    V lobuf[BLOCK_SIZE / sizeof(V)], hibuf[BLOCK_SIZE / sizeof(V)], avgbuf[BLOCK_SIZE / sizeof(V)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int k = 0; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                if (k == 0)
+                {
+                    for (int x = x0; x < x1; x += sizeof(V))
+                    {
+                        const V curx = load<V>(currp + x);
+                        const V pr0 = load<V>(prv0 + x);
+                        const V nx0 = load<V>(nxt0 + x);
+                        lobuf[(x - x0) / sizeof(V)] = min<T>(pr0, nx0);
+                        hibuf[(x - x0) / sizeof(V)] = max<T>(pr0, nx0);
+                        avgbuf[(x - x0) / sizeof(V)] = get_avg<T, V>(pr0, nx0, curx, q);
+                        V t0 = load<V>(r + x);
+                        if (plain)
+                            dbuf[(x - x0) / sizeof(V)] = abs_diff<T, V>(curx, t0);
+                        if (aggressive)
+                        {
+                            V t1 = max<T>(t0, curx);
+                            V t2 = cmpeq<T>(t0, t1);
+                            t0 = sub<T>(t1, min<T>(t0, curx));
+                            d1buf[(x - x0) / sizeof(V)] = and_reg(t2, t0);
+                            d2buf[(x - x0) / sizeof(V)] = andnot_reg(t2, t0);
+                        }
+                    }
+                }
+                else
+                {
+                    for (int x = x0; x < x1; x += sizeof(V))
+                    {
+                        const V curx = load<V>(currp + x);
+                        const V t0 = load<V>(r + x);
+                        if (plain)
+                            dbuf[(x - x0) / sizeof(V)] = min<T>(dbuf[(x - x0) / sizeof(V)], abs_diff<T, V>(curx, t0));
+                        if (aggressive)
+                            update_diff<T, V>(t0, curx, d1buf[(x - x0) / sizeof(V)], d2buf[(x - x0) / sizeof(V)], zero);
+                    }
+                }
+
+                // the variants whose references are all in: strength s ends with reference max(2 * s - 3, 0).
+                for (int v = 0; v < nvariants; ++v)
+                {
+                    if (max(variants[v].strength * 2 - 3, 0) != k)
+                        continue;
+                    const V* d1p = variants[v].aggressive ? d1buf : dbuf;
+                    const V* d2p = variants[v].aggressive ? d2buf : dbuf;
+                    for (int x = x0; x < x1; x += sizeof(V))
+                    {
+                        const int i = (x - x0) / sizeof(V);
+                        const V curx = load<V>(currp + x);
+                        const V ul = max<T>(sub<T>(lobuf[i], d1p[i]), curx);
+                        const V ll = min<T>(add<T>(hibuf[i], d2p[i]), curx);
+                        out(dst[v], x, clamp<T, V>(avgbuf[i], ll, ul), curx, avgbuf[i], lobuf[i]);
+                    }
+                }
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        for (int v = 0; v < nvariants; ++v)
+            dst[v] += dstride[v];
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+#define INSTANTIATE(T, STORE) \
+    template void proc_avx2<T, 1, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_avx2<T, 2, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_avx2<T, 3, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_a_avx2<T, 1, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_a_avx2<T, 2, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_a_avx2<T, 3, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_r_avx2<T, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_ra_avx2<T, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_f_avx2<T, false, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept; \
+    template void proc_f_avx2<T, true, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept; \
+    template void proc_p_avx2<T, false, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_p_avx2<T, true, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+
+INSTANTIATE(uint8_t, STORE_STREAM)
+INSTANTIATE(uint8_t, STORE_CACHED)
+INSTANTIATE(uint16_t, STORE_STREAM)
+INSTANTIATE(uint16_t, STORE_CACHED)
+INSTANTIATE(uint16_t, STORE_TO8)
+INSTANTIATE(uint16_t, STORE_TO16)
+INSTANTIATE(float, STORE_STREAM)
+INSTANTIATE(float, STORE_CACHED)
+INSTANTIATE(float, STORE_TO8)
+INSTANTIATE(float, STORE_TO16)
+INSTANTIATE(uint8_t, STORE_STREAM | STORE_STATS)
+INSTANTIATE(uint8_t, STORE_CACHED | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_STREAM | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_CACHED | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_TO8 | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_TO16 | STORE_STATS)
+INSTANTIATE(float, STORE_STREAM | STORE_STATS)
+INSTANTIATE(float, STORE_CACHED | STORE_STATS)
+INSTANTIATE(float, STORE_TO8 | STORE_STATS)
+INSTANTIATE(float, STORE_TO16 | STORE_STATS)
+INSTANTIATE(uint8_t, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(uint8_t, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(uint8_t, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(uint8_t, STORE_CACHED | STORE_STATS | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_CACHED | STORE_STATS | STORE_BOUND)
+INSTANTIATE(float, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(float, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(float, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(float, STORE_CACHED | STORE_STATS | STORE_BOUND)
+
+#undef INSTANTIATE
+
+#define INSTANTIATE(T, STORE) \
+    template void proc_v_avx2<T, STORE>(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept;
+
+INSTANTIATE(uint8_t, STORE_STREAM)
+INSTANTIATE(uint8_t, STORE_CACHED)
+INSTANTIATE(uint16_t, STORE_STREAM)
+INSTANTIATE(uint16_t, STORE_CACHED)
+INSTANTIATE(float, STORE_STREAM)
+INSTANTIATE(float, STORE_CACHED)
+
+#undef INSTANTIATE
+
+template void decimate_avx2<uint8_t>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template void decimate_avx2<uint16_t>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template void decimate_avx2<float>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+
+#define INSTANTIATE(T) \
+    template void spatial_avx2<T, 1>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept; \
+    template void spatial_avx2<T, 2>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept; \
+    template void spatial_avx2<T, 3>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept; \
+    template void spatial_avx2<T, 4>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+
+INSTANTIATE(uint8_t)
+INSTANTIATE(uint16_t)
+INSTANTIATE(float)
+
+#undef INSTANTIATE
+
+#define INSTANTIATE(STORE) \
+    template void proc_h_avx2<false, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_h_avx2<true, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+
+INSTANTIATE(STORE_STREAM)
+INSTANTIATE(STORE_CACHED)
+INSTANTIATE(STORE_TO8)
+INSTANTIATE(STORE_TO16)
+INSTANTIATE(STORE_STREAM | STORE_STATS)
+INSTANTIATE(STORE_CACHED | STORE_STATS)
+INSTANTIATE(STORE_TO8 | STORE_STATS)
+INSTANTIATE(STORE_TO16 | STORE_STATS)
+INSTANTIATE(STORE_STREAM | STORE_BOUND)
+INSTANTIATE(STORE_CACHED | STORE_BOUND)
+INSTANTIATE(STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(STORE_CACHED | STORE_STATS | STORE_BOUND)
 
-template void proc_a_avx2<uint8_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_avx2<uint16_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_avx2<float, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+#undef INSTANTIATE
 
-template void proc_a_avx2<uint8_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_avx2<uint16_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_avx2<float, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+#endif // REDUCEFLICKER_X86
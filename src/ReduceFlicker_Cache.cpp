@@ -0,0 +1,165 @@
+#include <atomic>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ReduceFlicker.h"
+
+// 64-bit hash of the rows of a plane: 4 interleaved multiply/xorshift lanes, folded at the end.
+uint64_t hash_bytes(uint64_t seed, const uint8_t* p, int pitch, int rowsize, int height) noexcept
+{
+    constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h[4] = { seed ^ k, seed + k, seed ^ (k >> 1), seed + (k << 1) };
+
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t* row = p + static_cast<size_t>(pitch) * y;
+        int x = 0;
+        for (; x + 32 <= rowsize; x += 32)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                uint64_t w;
+                memcpy(&w, row + x + i * 8, 8);
+                h[i] = (h[i] ^ w) * k;
+                h[i] ^= h[i] >> 32;
+            }
+        }
+        for (int i = 0; x < rowsize; ++i, x += 8)
+        {
+            uint64_t w = 0;
+            memcpy(&w, row + x, min(rowsize - x, 8));
+            h[i] = (h[i] ^ w) * k;
+            h[i] ^= h[i] >> 32;
+        }
+    }
+
+    uint64_t r = static_cast<uint64_t>(rowsize) << 32 | static_cast<uint32_t>(height);
+    for (int i = 0; i < 4; ++i)
+    {
+        r = (r ^ h[i]) * k;
+        r ^= r >> 29;
+    }
+    return r;
+}
+
+// File: header (4 KiB), keys of the slots, slots (each aligned to 4 KiB).
+// A key is cleared before its slot is written and set once the slot is complete,
+// so an interrupted run leaves no slot that looks valid.
+namespace {
+    constexpr char CACHE_MAGIC[8] = { 'R', 'F', 'C', 'A', 'C', 'H', 'E', '1' };
+    constexpr size_t CACHE_PAGE = 4096;
+
+    struct CacheHeader
+    {
+        char magic[8];
+        uint64_t params;
+        int64_t num_frames;
+        int64_t slot_size;
+    };
+
+    size_t round_page(size_t size)
+    {
+        return (size + CACHE_PAGE - 1) / CACHE_PAGE * CACHE_PAGE;
+    }
+}
+
+OutputCache::OutputCache(const char* path, uint64_t params, int nf, size_t frame_size) :
+    file(nullptr), mapping(nullptr), base(nullptr), size(0), slot_size(round_page(frame_size)), num_frames(nf)
+{
+    const size_t keys_size = round_page(sizeof(uint64_t) * num_frames);
+    size = CACHE_PAGE + keys_size + slot_size * num_frames;
+
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+        return;
+    file = f;
+    LARGE_INTEGER old_size;
+    if (!GetFileSizeEx(f, &old_size))
+        return;
+    const bool resized = static_cast<size_t>(old_size.QuadPart) != size;
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr);
+    if (!m)
+        return;
+    mapping = m;
+    void* p = MapViewOfFile(m, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!p)
+        return;
+#else
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+    file = reinterpret_cast<void*>(static_cast<intptr_t>(fd) + 1);
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return;
+    const bool resized = static_cast<size_t>(st.st_size) != size;
+    if (resized && ftruncate(fd, static_cast<off_t>(size)) != 0)
+        return;
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return;
+#endif
+    base = static_cast<uint8_t*>(p);
+
+    CacheHeader* header = reinterpret_cast<CacheHeader*>(base);
+    if (resized || memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header->params != params
+        || header->num_frames != num_frames || header->slot_size != static_cast<int64_t>(slot_size))
+    {
+        memset(base + CACHE_PAGE, 0, keys_size);
+        header->params = params;
+        header->num_frames = num_frames;
+        header->slot_size = static_cast<int64_t>(slot_size);
+        memcpy(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    }
+}
+
+OutputCache::~OutputCache()
+{
+#ifdef _WIN32
+    if (base)
+        UnmapViewOfFile(base);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+#else
+    if (base)
+        munmap(base, size);
+    if (file)
+        close(static_cast<int>(reinterpret_cast<intptr_t>(file) - 1));
+#endif
+}
+
+static std::atomic<uint64_t>* slot_key(uint8_t* base, int n)
+{
+    return reinterpret_cast<std::atomic<uint64_t>*>(base + CACHE_PAGE) + n;
+}
+
+const uint8_t* OutputCache::find(int n, uint64_t key) const
+{
+    if (slot_key(base, n)->load(std::memory_order_acquire) != key)
+        return nullptr;
+    return base + CACHE_PAGE + round_page(sizeof(uint64_t) * num_frames) + slot_size * n;
+}
+
+uint8_t* OutputCache::begin_store(int n)
+{
+    slot_key(base, n)->store(0, std::memory_order_release);
+    return base + CACHE_PAGE + round_page(sizeof(uint64_t) * num_frames) + slot_size * n;
+}
+
+void OutputCache::commit(int n, uint64_t key)
+{
+    slot_key(base, n)->store(key, std::memory_order_release);
+}
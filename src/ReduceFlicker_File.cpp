@@ -0,0 +1,274 @@
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ReduceFlicker.h"
+#ifndef REDUCEFLICKER_EXPORTS
+#define REDUCEFLICKER_EXPORTS
+#endif
+#include "ReduceFlicker_API.h"
+
+namespace {
+    // Whole file mapped in memory: the source read-only, the output created with the size of the source.
+    class MappedFile
+    {
+        void* file = nullptr;
+        void* mapping = nullptr;
+        uint8_t* base = nullptr;
+        size_t size = 0;
+
+    public:
+        // size 0: opens an existing file for reading, otherwise creates (or truncates) a file of that size for writing.
+        MappedFile(const char* path, size_t new_size)
+        {
+            const bool write = new_size > 0;
+#ifdef _WIN32
+            HANDLE f = CreateFileA(path, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+                write ? CREATE_ALWAYS : OPEN_EXISTING, write ? FILE_ATTRIBUTE_NORMAL : FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (f == INVALID_HANDLE_VALUE)
+                return;
+            file = f;
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(f, &file_size))
+                return;
+            size = write ? new_size : static_cast<size_t>(file_size.QuadPart);
+            if (size == 0)
+                return;
+            HANDLE m = CreateFileMappingA(f, nullptr, write ? PAGE_READWRITE : PAGE_READONLY, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr);
+            if (!m)
+                return;
+            mapping = m;
+            void* p = MapViewOfFile(m, write ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+            if (!p)
+                return;
+#else
+            const int fd = write ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+            if (fd < 0)
+                return;
+            file = reinterpret_cast<void*>(static_cast<intptr_t>(fd) + 1);
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+                return;
+            size = write ? new_size : static_cast<size_t>(st.st_size);
+            if (size == 0 || (write && ftruncate(fd, static_cast<off_t>(size)) != 0))
+                return;
+            void* p = mmap(nullptr, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+                return;
+            // the frames are read in order, a window at a time: large read ahead.
+            if (!write)
+                madvise(p, size, MADV_SEQUENTIAL);
+#endif
+            base = static_cast<uint8_t*>(p);
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (base)
+                UnmapViewOfFile(base);
+            if (mapping)
+                CloseHandle(mapping);
+            if (file)
+                CloseHandle(file);
+#else
+            if (base)
+                munmap(base, size);
+            if (file)
+                close(static_cast<int>(reinterpret_cast<intptr_t>(file) - 1));
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        uint8_t* data() const { return base; }
+        size_t length() const { return size; }
+    };
+
+    // Format of the frames: planes of width >> ssw x height >> ssh for the chroma, 1 plane when mono.
+    struct FileFormat
+    {
+        int width, height, bits;
+        int ssw, ssh;
+        bool mono;
+        size_t header;      // bytes before the first frame
+        bool y4m;           // each frame starts with a "FRAME" line
+    };
+
+    bool set_chroma(FileFormat& f, int chroma)
+    {
+        f.mono = chroma == 400;
+        f.ssw = chroma == 420 || chroma == 422;
+        f.ssh = chroma == 420;
+        return chroma == 420 || chroma == 422 || chroma == 444 || chroma == 400;
+    }
+
+    // "YUV4MPEG2 W1920 H1080 F25:1 Ip A1:1 C420jpeg\n": W, H and C (chroma and bit depth, 4:2:0 8-bit by default).
+    bool parse_y4m(const uint8_t* p, size_t size, FileFormat& f)
+    {
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(p, '\n', min<size_t>(size, 1024)));
+        if (!end)
+            return false;
+        const std::string line(reinterpret_cast<const char*>(p), end - p);
+
+        f.width = f.height = 0;
+        f.bits = 8;
+        set_chroma(f, 420);
+        for (size_t pos = 10; pos < line.size();)
+        {
+            size_t next = line.find(' ', pos);
+            if (next == std::string::npos)
+                next = line.size();
+            const std::string token = line.substr(pos, next - pos);
+            pos = next + 1;
+            if (token.empty())
+                continue;
+
+            if (token[0] == 'W')
+                f.width = atoi(token.c_str() + 1);
+            else if (token[0] == 'H')
+                f.height = atoi(token.c_str() + 1);
+            else if (token[0] == 'C')
+            {
+                // 420jpeg, 420paldv, 420mpeg2, 422, 444p10, mono, mono16...: no alpha plane.
+                const std::string c = token.substr(1);
+                const bool mono = c.compare(0, 4, "mono") == 0;
+                const int chroma = mono ? 400 : atoi(c.c_str());
+                size_t rest = mono ? 4 : 0;
+                while (rest < c.size() && isdigit(static_cast<unsigned char>(c[rest])))
+                    ++rest;
+                if (rest < c.size() && c[rest] == 'p' && rest + 1 < c.size() && isdigit(static_cast<unsigned char>(c[rest + 1])))
+                    f.bits = atoi(c.c_str() + rest + 1);
+                else if (mono && rest > 4)
+                    f.bits = atoi(c.c_str() + 4);
+                else if (rest < c.size() && c.compare(rest, std::string::npos, "jpeg") != 0 && c.compare(rest, std::string::npos, "paldv") != 0 && c.compare(rest, std::string::npos, "mpeg2") != 0)
+                    return false;
+                if (!set_chroma(f, chroma))
+                    return false;
+            }
+        }
+        f.header = end - p + 1;
+        f.y4m = true;
+        return f.width > 0 && f.height > 0 && f.bits >= 8 && f.bits <= 16;
+    }
+}
+
+// The planes of each frame are used in place in the mapping of the source, and the output is written into the mapping
+// of the destination: the routines read the window from the page cache, nothing is copied or allocated per frame.
+// The planes of a file are only aligned when the size of the frames (and of their headers) is: the AVX2 routines
+// take unaligned rows, without AVX2 the frames that aren't aligned to 16 bytes use the C routines.
+int ReduceFlicker_ProcessFile(const char* src_path, const char* dst_path, int width, int height, int chroma, int bits, int strength, int aggressive, int threads, int opt)
+{
+    if (!src_path || !dst_path || strcmp(src_path, dst_path) == 0)
+        return -1;
+    MappedFile src(src_path, 0);
+    if (!src.data())
+        return -1;
+    const uint8_t* sp = src.data();
+    const size_t ssize = src.length();
+
+    FileFormat f;
+    if (ssize >= 10 && memcmp(sp, "YUV4MPEG2 ", 10) == 0)
+    {
+        if (!parse_y4m(sp, ssize, f))
+            return -1;
+    }
+    else
+    {
+        f.width = width;
+        f.height = height;
+        f.bits = bits;
+        f.header = 0;
+        f.y4m = false;
+        if (width < 1 || height < 1 || !set_chroma(f, chroma) || bits < 8 || (bits > 16 && bits != 32))
+            return -1;
+    }
+
+    const int size = f.bits == 8 ? 1 : f.bits == 32 ? 4 : 2;
+    const int nplanes = f.mono ? 1 : 3;
+    int pwidth[3], pheight[3];
+    size_t poffset[3];
+    size_t frame_size = 0;
+    for (int i = 0; i < nplanes; ++i)
+    {
+        pwidth[i] = i == 0 ? f.width : (f.width + (1 << f.ssw) - 1) >> f.ssw;
+        pheight[i] = i == 0 ? f.height : (f.height + (1 << f.ssh) - 1) >> f.ssh;
+        poffset[i] = frame_size;
+        frame_size += static_cast<size_t>(pwidth[i]) * pheight[i] * size;
+    }
+
+    // offsets of the frames (after their "FRAME" line for Y4M).
+    std::vector<size_t> frames;
+    for (size_t pos = f.header; pos < ssize;)
+    {
+        if (f.y4m)
+        {
+            if (ssize - pos < 6 || memcmp(sp + pos, "FRAME", 5) != 0)
+                return -1;
+            const uint8_t* end = static_cast<const uint8_t*>(memchr(sp + pos, '\n', min<size_t>(ssize - pos, 1024)));
+            if (!end)
+                return -1;
+            pos = end - sp + 1;
+        }
+        if (ssize - pos < frame_size)
+            return -1;
+        frames.push_back(pos);
+        pos += frame_size;
+    }
+    if (frames.empty())
+        return -1;
+
+    MappedFile dst(dst_path, ssize);
+    if (!dst.data())
+        return -1;
+    uint8_t* dp = dst.data();
+
+    // the headers are copied, the planes are written by the routines.
+    memcpy(dp, sp, f.header);
+    if (f.y4m)
+        for (size_t n = 0; n < frames.size(); ++n)
+        {
+            const size_t begin = n == 0 ? f.header : frames[n - 1] + frame_size;
+            memcpy(dp + begin, sp + begin, frames[n] - begin);
+        }
+
+    const int num_frames = static_cast<int>(frames.size());
+    std::vector<const uint8_t*> srcp(static_cast<size_t>(num_frames) * nplanes);
+    std::vector<uint8_t*> dstp(srcp.size());
+    std::vector<int> pitches(srcp.size());
+    for (int i = 0; i < nplanes; ++i)
+    {
+        const size_t base = static_cast<size_t>(num_frames) * i;
+        for (int n = 0; n < num_frames; ++n)
+        {
+            srcp[base + n] = sp + frames[n] + poffset[i];
+            dstp[base + n] = dp + frames[n] + poffset[i];
+            pitches[base + n] = pwidth[i] * size;
+        }
+    }
+
+    // One batch for the whole file, validated and run by one pool of threads: the jobs go by frame, with all its planes,
+    // so that the file is read once in order.
+    ReduceFlickerStream streams[3];
+    for (int i = 0; i < nplanes; ++i)
+    {
+        const size_t base = static_cast<size_t>(num_frames) * i;
+        streams[i] = { dstp.data() + base, pitches.data() + base, srcp.data() + base, pitches.data() + base,
+            num_frames, 0, num_frames - 1, pwidth[i], pheight[i], f.bits, strength, aggressive };
+    }
+    return ReduceFlicker_ProcessBatch(streams, nplanes, threads, opt);
+}
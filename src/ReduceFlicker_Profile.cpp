@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "ReduceFlicker.h"
+
+// Counters of the calling thread, user mode only: cycles (group leader), instructions, last level cache misses.
+PerfCounters::PerfCounters() : fd{ -1, -1, -1 }, t0(0.0)
+{
+#ifdef __linux__
+    constexpr uint64_t events[3] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+    for (int i = 0; i < 3; ++i)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i];
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        fd[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fd[0], 0));
+        if (fd[i] < 0)
+        {
+            // no counters (no PMU, virtual machine, perf_event_paranoid): only the time is measured.
+            for (int j = 0; j < i; ++j)
+                close(fd[j]);
+            fd[0] = fd[1] = fd[2] = -1;
+            return;
+        }
+    }
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (int i = 0; i < 3; ++i)
+        if (fd[i] >= 0)
+            close(fd[i]);
+#endif
+}
+
+static double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PerfCounters::start()
+{
+#ifdef __linux__
+    if (fd[0] >= 0)
+    {
+        ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    t0 = seconds();
+}
+
+PerfSample PerfCounters::stop()
+{
+    PerfSample s = { seconds() - t0, -1, -1, -1 };
+#ifdef __linux__
+    if (fd[0] >= 0)
+    {
+        ioctl(fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[4];   // number of events, then the values
+        if (read(fd[0], values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)) && values[0] == 3)
+        {
+            s.cycles = static_cast<int64_t>(values[1]);
+            s.instructions = static_cast<int64_t>(values[2]);
+            s.llc_misses = static_cast<int64_t>(values[3]);
+        }
+    }
+#endif
+    return s;
+}
+
+// Best of a few copies between two buffers larger than any last level cache (read + write, bytes/s).
+double copy_bandwidth()
+{
+    constexpr size_t size = 128 << 20;
+    std::unique_ptr<uint8_t[]> src(new uint8_t[size]), dst(new uint8_t[size]);
+    memset(src.get(), 1, size);
+    memset(dst.get(), 0, size);
+
+    double best = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const double t = seconds();
+        memcpy(dst.get(), src.get(), size);
+        const double dt = seconds() - t;
+        if (dt > 0.0)
+            best = max(best, 2.0 * size / dt);
+        src[i] = dst[size - 1 - i];
+    }
+    return best;
+}
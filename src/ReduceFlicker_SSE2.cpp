@@ -1,7 +1,8 @@
-#include <emmintrin.h>
-
 #include "ReduceFlicker.h"
 
+#if REDUCEFLICKER_X86
+#include <emmintrin.h>
+
 /********************* LOAD ****************************************/
 template <typename V> static F_INLINE V load(const uint8_t* p);
 
@@ -16,6 +17,49 @@ F_INLINE __m128 load(const uint8_t* p)
     return _mm_load_ps(reinterpret_cast<const float*>(p));
 }
 
+// spatial: the left and right neighbours are one sample away from the aligned columns.
+template <typename V> static F_INLINE V loadu(const uint8_t* p);
+
+template <>
+F_INLINE __m128i loadu<__m128i>(const uint8_t* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+template <>
+F_INLINE __m128 loadu(const uint8_t* p)
+{
+    return _mm_loadu_ps(reinterpret_cast<const float*>(p));
+}
+
+/********************* LOAD HALF ***********************************/
+// fast mode: loads half a register of the half resolution bound and repeats each value twice.
+template <typename T, typename V> static F_INLINE V load_half(const uint8_t* p);
+
+template <>
+F_INLINE __m128i load_half<uint8_t, __m128i>(const uint8_t* p)
+{
+    const __m128i t = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm_unpacklo_epi8(t, t);
+}
+template <>
+F_INLINE __m128i load_half<uint16_t, __m128i>(const uint8_t* p)
+{
+    const __m128i t = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm_unpacklo_epi16(t, t);
+}
+template <>
+F_INLINE __m128i load_half<int16_t, __m128i>(const uint8_t* p)
+{
+    return load_half<uint16_t, __m128i>(p);
+}
+template <>
+F_INLINE __m128 load_half<float, __m128>(const uint8_t* p)
+{
+    // movq through __m128i (may alias anything): _mm_load_sd reads a double, which GCC takes for an uninitialized read of the __m128 buffers.
+    const __m128 t = _mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    return _mm_unpacklo_ps(t, t);
+}
+
 /********************* STORE *************************************/
 static F_INLINE void stream(uint8_t* p, const __m128i& x)
 {
@@ -27,6 +71,16 @@ static F_INLINE void stream(uint8_t* p, const __m128& x)
     _mm_stream_ps(reinterpret_cast<float*>(p), x);
 }
 
+static F_INLINE void store(uint8_t* p, const __m128i& x)
+{
+    _mm_store_si128(reinterpret_cast<__m128i*>(p), x);
+}
+
+static F_INLINE void store(uint8_t* p, const __m128& x)
+{
+    _mm_store_ps(reinterpret_cast<float*>(p), x);
+}
+
 /************************ SETZERO *********************************/
 template <typename V> static F_INLINE V setzero();
 
@@ -142,6 +196,13 @@ F_INLINE __m128i add<uint8_t>(const __m128i& x, const __m128i& y)
     return _mm_adds_epu8(x, y);
 }
 
+// int16_t: the sum saturates at 0x7FFF (the peak of 15-bit), so that the signed min/max below see it as positive.
+template <>
+F_INLINE __m128i add<int16_t>(const __m128i& x, const __m128i& y)
+{
+    return _mm_adds_epi16(x, y);
+}
+
 template <typename T>
 static F_INLINE __m128 add(const __m128& x, const __m128& y)
 {
@@ -167,6 +228,13 @@ F_INLINE __m128i max<uint8_t>(const __m128i& x, const __m128i& y)
     return _mm_max_epu8(x, y);
 }
 
+// int16_t: 16-bit samples below 0x8000 (9..15-bit), signed min/max are single instructions (the sums saturate at 0x7FFF, see add).
+template <>
+F_INLINE __m128i max<int16_t>(const __m128i& x, const __m128i& y)
+{
+    return _mm_max_epi16(x, y);
+}
+
 /************************ MIN ************************************/
 template <typename T>
 static F_INLINE __m128 min(const __m128& x, const __m128& y)
@@ -186,6 +254,12 @@ F_INLINE __m128i min<uint8_t>(const __m128i& x, const __m128i& y)
     return _mm_min_epu8(x, y);
 }
 
+template <>
+F_INLINE __m128i min<int16_t>(const __m128i& x, const __m128i& y)
+{
+    return _mm_min_epi16(x, y);
+}
+
 /***************************** ABS_DIFF *************************************/
 template <typename T, typename V>
 static F_INLINE V abs_diff(const V& x, const V& y)
@@ -244,11 +318,210 @@ blendv(const __m128& x, const __m128& y, const __m128& mask)
 static F_INLINE __m128i
 blendv(const __m128i& x, const __m128i& y, const __m128i& mask)
 {
-    return _mm_or_si128(_mm_and_si128(mask, y), _mm_andnot_si128(mask, y));
+    return _mm_or_si128(_mm_and_si128(mask, y), _mm_andnot_si128(mask, x));
 }
 
-template <typename T, int STRENGTH>
-void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept
+/****************************** OUTPUT *************************/
+template <typename T, int STORE>
+class Output
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+
+    static constexpr int MODE = store_mode(STORE);
+    static constexpr bool STATS = (STORE & STORE_STATS) != 0;
+    static constexpr bool BOUND = (STORE & STORE_BOUND) != 0;
+    using S = std::conditional_t<std::is_integral_v<T>, int64_t, double>;
+
+    const OutputParams* op;
+    V offs[2], peak, scale;
+    __m128i shift;
+    // STATS: the sums of the current row are kept in the registers and added to the sums of the plane by flush().
+    int width;
+    V sdiff, stdiff;
+    __m128i sclamped;
+    S diff, tdiff;
+    int64_t clamped;
+    // BOUND: the current row of the bound plane.
+    uint8_t* brow;
+
+    template <typename L, typename A, typename R>
+    static F_INLINE void add_lanes(A& sum, R& reg) noexcept
+    {
+        alignas(16) L t[sizeof(R) / sizeof(L)];
+        store(reinterpret_cast<uint8_t*>(t), reg);
+        for (const L l : t)
+            sum += l;
+        reg = setzero<R>();
+    }
+
+    F_INLINE void flush() noexcept
+    {
+        if constexpr (std::is_same_v<T, uint8_t>)
+        {
+            add_lanes<int64_t>(diff, sdiff);
+            add_lanes<int64_t>(tdiff, stdiff);
+            add_lanes<int64_t>(clamped, sclamped);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            add_lanes<uint32_t>(diff, sdiff);
+            add_lanes<uint32_t>(tdiff, stdiff);
+            add_lanes<uint16_t>(clamped, sclamped);
+        }
+        else
+        {
+            add_lanes<float>(diff, sdiff);
+            add_lanes<float>(tdiff, stdiff);
+            add_lanes<int32_t>(clamped, sclamped);
+        }
+    }
+
+    // lanes of the padding at the right of the plane are not counted.
+    F_INLINE V tail_mask(int x) const noexcept
+    {
+        alignas(16) static constexpr uint8_t table[sizeof(V) * 2] = {
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        };
+        const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + sizeof(V) - min(width - x, static_cast<int>(sizeof(V)))));
+        if constexpr (std::is_integral_v<T>)
+            return m;
+        else
+            return _mm_castsi128_ps(m);
+    }
+
+    F_INLINE void accumulate(int x, const V& val, const V& cur, const V& avg, const V& prv) noexcept
+    {
+        const V m = tail_mask(x);
+        const V d = and_reg(m, abs_diff<T, V>(val, cur));
+        const V t = and_reg(m, abs_diff<T, V>(cur, prv));
+        const V ne = andnot_reg(cmpeq<T>(val, avg), m);
+        if constexpr (std::is_same_v<T, uint8_t>)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            sdiff = _mm_add_epi64(sdiff, _mm_sad_epu8(d, zero));
+            stdiff = _mm_add_epi64(stdiff, _mm_sad_epu8(t, zero));
+            sclamped = _mm_add_epi64(sclamped, _mm_sad_epu8(_mm_and_si128(ne, _mm_set1_epi8(1)), zero));
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            sdiff = _mm_add_epi32(sdiff, _mm_add_epi32(_mm_unpacklo_epi16(d, zero), _mm_unpackhi_epi16(d, zero)));
+            stdiff = _mm_add_epi32(stdiff, _mm_add_epi32(_mm_unpacklo_epi16(t, zero), _mm_unpackhi_epi16(t, zero)));
+            sclamped = _mm_sub_epi16(sclamped, ne);
+        }
+        else
+        {
+            sdiff = _mm_add_ps(sdiff, d);
+            stdiff = _mm_add_ps(stdiff, t);
+            sclamped = _mm_sub_epi32(sclamped, _mm_castps_si128(ne));
+        }
+    }
+
+public:
+    Output(const OutputParams* p, int w) noexcept : op(p), width(w)
+    {
+        if constexpr (STATS)
+        {
+            sdiff = stdiff = setzero<V>();
+            sclamped = setzero<__m128i>();
+            diff = tdiff = 0;
+            clamped = 0;
+        }
+        if constexpr (MODE == STORE_TO8 || MODE == STORE_TO16)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                peak = _mm_set1_epi16(static_cast<int16_t>(op->peak));
+                shift = _mm_cvtsi32_si128(op->shift);
+            }
+            else
+            {
+                peak = _mm_set1_ps(static_cast<float>(op->peak));
+                scale = _mm_set1_ps(op->scale);
+            }
+        }
+    }
+
+    ~Output()
+    {
+        if constexpr (STATS)
+        {
+            flush();
+            op->stats->diff += static_cast<double>(diff);
+            op->stats->tdiff += static_cast<double>(tdiff);
+            op->stats->clamped += clamped;
+        }
+    }
+
+    F_INLINE void set_row(int y) noexcept
+    {
+        if constexpr (STATS)
+            flush();
+        if constexpr (BOUND)
+            brow = op->bound + static_cast<size_t>(op->bstride) * y;
+        if constexpr (MODE == STORE_TO8 || MODE == STORE_TO16)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                offs[0] = offs[1] = load<__m128i>(reinterpret_cast<const uint8_t*>(op->ioffs[y & 7]));
+            }
+            else
+            {
+                offs[0] = load<__m128>(reinterpret_cast<const uint8_t*>(op->foffs[y & 7]));
+                offs[1] = load<__m128>(reinterpret_cast<const uint8_t*>(op->foffs[y & 7] + 4));
+            }
+        }
+    }
+
+    // the bound of the pixels at x, max(d1, d2) when aggressive (the bounds are equal otherwise).
+    F_INLINE void bound(int x, const V& d1, const V& d2) noexcept
+    {
+        if constexpr (BOUND)
+            store(brow + x, max<T>(d1, d2));
+    }
+
+    F_INLINE void operator()(uint8_t* dstp, int x, const V& val, const V& cur, const V& avg, const V& prv) noexcept
+    {
+        if constexpr (STATS)
+            accumulate(x, val, cur, avg, prv);
+
+        if constexpr (MODE == STORE_STREAM)
+        {
+            stream(dstp + x, val);
+        }
+        else if constexpr (MODE == STORE_CACHED)
+        {
+            store(dstp + x, val);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            const __m128i t = _mm_srl_epi16(_mm_adds_epu16(val, offs[0]), shift);
+            if constexpr (MODE == STORE_TO8)
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp + x / 2), _mm_packus_epi16(t, t));
+            else
+                stream(dstp + x, _mm_min_epi16(t, peak));
+        }
+        else
+        {
+            const __m128 t = _mm_add_ps(_mm_mul_ps(val, scale), offs[(x >> 4) & 1]);
+            __m128i i = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), peak));
+            if constexpr (MODE == STORE_TO8)
+            {
+                i = _mm_packs_epi32(i, i);
+                *reinterpret_cast<int32_t*>(dstp + x / 4) = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+            }
+            else
+            {
+                // there is no packus_epi32 in SSE2.
+                i = _mm_packs_epi32(_mm_sub_epi32(i, _mm_set1_epi32(0x8000)), _mm_setzero_si128());
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dstp + x / 2), _mm_xor_si128(i, _mm_set1_epi16(-0x8000)));
+            }
+        }
+    }
+};
+
+template <typename T, int STRENGTH, int STORE>
+void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
 {
     using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
 
@@ -269,9 +542,11 @@ void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const
     width *= sizeof(T);
 
     V q = set1<T, V>();
+    Output<T, STORE> out(op, width);
 
     for (int y = 0; y < height; ++y)
     {
+        out.set_row(y);
         for (int x = 0; x < width; x += sizeof(V))
         {
             const V curx = load<V>(currp + x);
@@ -290,7 +565,8 @@ void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const
             const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d), curx);
             const V ll = min<T>(add<T>(max<T>(pr0, nx0), d), curx);
             const V avg = get_avg<T, V>(pr0, nx0, curx, q);
-            stream(dstp + x, clamp<T, V>(avg, ll, ul));
+            out.bound(x, d, d);
+            out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
         }
         prv0 += pstride[0];
         prv1 += pstride[1];
@@ -309,18 +585,6 @@ void proc_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const
     }
 }
 
-template void proc_sse2<uint8_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_sse2<uint16_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_sse2<float, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-
-template void proc_sse2<uint8_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_sse2<uint16_t,  2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_sse2<float, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-
-template void proc_sse2<uint8_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_sse2<uint16_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_sse2<float, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-
 template <typename T, typename V>
 static F_INLINE void
 update_diff(const V& x, const V& y, V& d1, V& d2, const V& zero)
@@ -332,8 +596,8 @@ update_diff(const V& x, const V& y, V& d1, V& d2, const V& zero)
     d2 = blendv(min<T>(d, d2), zero, mask);
 }
 
-template <typename T, int STRENGTH>
-void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept
+template <typename T, int STRENGTH, int STORE>
+void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
 {
     using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
 
@@ -354,10 +618,12 @@ void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, con
     width *= sizeof(T);
 
     V q = set1<T, V>();
+    Output<T, STORE> out(op, width);
     V zero = setzero<V>();
 
     for (int y = 0; y < height; ++y)
     {
+        out.set_row(y);
         for (int x = 0; x < width; x += sizeof(V))
         {
             const V curx = load<V>(currp + x);
@@ -381,7 +647,8 @@ void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, con
             const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d1), curx);
             const V ll = min<T>(add<T>(max<T>(pr0, nx0), d2), curx);
             const V avg = get_avg<T, V>(pr0, nx0, curx, q);
-            stream(dstp + x, clamp<T, V>(avg, ll, ul));
+            out.bound(x, d1, d2);
+            out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
         }
         prv0 += pstride[0];
         prv1 += pstride[1];
@@ -401,14 +668,612 @@ void proc_a_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, con
 
 }
 
-template void proc_a_sse2<uint8_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_sse2<uint16_t, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_sse2<float, 1>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+// Runtime strength (> 3). The bound of a block of pixels is accumulated one reference frame at a time,
+// so the number of references does not change the working set of the inner loops.
+constexpr int BLOCK_SIZE = 2048;
+
+template <typename T, int STORE>
+void proc_r_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    const int nrefs = strength * 2 - 2;
+    for (int k = 1; k < strength; ++k)
+    {
+        refp[k * 2 - 2] = prevp[k];
+        rstride[k * 2 - 2] = pstride[k];
+        refp[k * 2 - 1] = nextp[k];
+        rstride[k * 2 - 1] = nstride[k];
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    Output<T, STORE> out(op, width);
+    V dbuf[BLOCK_SIZE / sizeof(V)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0; x < x1; x += sizeof(V))
+                dbuf[(x - x0) / sizeof(V)] = abs_diff<T, V>(load<V>(currp + x), load<V>(refp[0] + x));
+            for (int k = 1; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                for (int x = x0; x < x1; x += sizeof(V))
+                    dbuf[(x - x0) / sizeof(V)] = min<T>(dbuf[(x - x0) / sizeof(V)], abs_diff<T, V>(load<V>(currp + x), load<V>(r + x)));
+            }
+
+            for (int x = x0; x < x1; x += sizeof(V))
+            {
+                const V curx = load<V>(currp + x);
+                const V pr0 = load<V>(prv0 + x);
+                const V nx0 = load<V>(nxt0 + x);
+                const V ul = max<T>(sub<T>(min<T>(pr0, nx0), dbuf[(x - x0) / sizeof(V)]), curx);
+                const V ll = min<T>(add<T>(max<T>(pr0, nx0), dbuf[(x - x0) / sizeof(V)]), curx);
+                const V avg = get_avg<T, V>(pr0, nx0, curx, q);
+                out.bound(x, dbuf[(x - x0) / sizeof(V)], dbuf[(x - x0) / sizeof(V)]);
+                out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+template <typename T, int STORE>
+void proc_ra_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    const int nrefs = strength * 2 - 2;
+    for (int k = 1; k < strength; ++k)
+    {
+        refp[k * 2 - 2] = prevp[k];
+        rstride[k * 2 - 2] = pstride[k];
+        refp[k * 2 - 1] = nextp[k];
+        rstride[k * 2 - 1] = nstride[k];
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+    V d1buf[BLOCK_SIZE / sizeof(V)], d2buf[BLOCK_SIZE / sizeof(V)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0; x < x1; x += sizeof(V))
+            {
+                const V curx = load<V>(currp + x);
+                V t0 = load<V>(refp[0] + x);
+                V t1 = max<T>(t0, curx);
+                V t2 = cmpeq<T>(t0, t1);
+                t0 = sub<T>(t1, min<T>(t0, curx));
+                d1buf[(x - x0) / sizeof(V)] = and_reg(t2, t0);
+                d2buf[(x - x0) / sizeof(V)] = andnot_reg(t2, t0);
+            }
+            for (int k = 1; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                for (int x = x0; x < x1; x += sizeof(V))
+                    update_diff<T, V>(load<V>(r + x), load<V>(currp + x), d1buf[(x - x0) / sizeof(V)], d2buf[(x - x0) / sizeof(V)], zero);
+            }
+
+            for (int x = x0; x < x1; x += sizeof(V))
+            {
+                const V curx = load<V>(currp + x);
+                const V pr0 = load<V>(prv0 + x);
+                const V nx0 = load<V>(nxt0 + x);
+                const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d1buf[(x - x0) / sizeof(V)]), curx);
+                const V ll = min<T>(add<T>(max<T>(pr0, nx0), d2buf[(x - x0) / sizeof(V)]), curx);
+                const V avg = get_avg<T, V>(pr0, nx0, curx, q);
+                out.bound(x, d1buf[(x - x0) / sizeof(V)], d2buf[(x - x0) / sizeof(V)]);
+                out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+// fast mode: 2x2 average (same rounding as decimate_c), 16 bytes of two rows to 8 bytes.
+template <typename T>
+void decimate_sse2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    const int hheight = (height + 1) / 2;
+    const int bwidth = width * static_cast<int>(sizeof(T));
+
+    for (int y = 0; y < hheight; ++y)
+    {
+        uint8_t* dst = dstp + static_cast<size_t>(dstride) * y;
+        const uint8_t* s0 = srcp + static_cast<size_t>(sstride) * y * 2;
+        const uint8_t* s1 = srcp + static_cast<size_t>(sstride) * min(y * 2 + 1, height - 1);
+
+        for (int x = 0; x < bwidth; x += 16)
+        {
+            if constexpr (std::is_same_v<T, uint8_t>)
+            {
+                const __m128i r0 = load<__m128i>(s0 + x);
+                const __m128i r1 = load<__m128i>(s1 + x);
+                const __m128i mask = _mm_set1_epi16(0x00FF);
+                __m128i t = _mm_add_epi16(_mm_and_si128(r0, mask), _mm_srli_epi16(r0, 8));
+                t = _mm_add_epi16(t, _mm_add_epi16(_mm_and_si128(r1, mask), _mm_srli_epi16(r1, 8)));
+                t = _mm_srli_epi16(_mm_add_epi16(t, _mm_set1_epi16(2)), 2);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x / 2), _mm_packus_epi16(t, t));
+            }
+            else if constexpr (std::is_same_v<T, uint16_t>)
+            {
+                const __m128i r0 = load<__m128i>(s0 + x);
+                const __m128i r1 = load<__m128i>(s1 + x);
+                const __m128i mask = _mm_set1_epi32(0xFFFF);
+                __m128i t = _mm_add_epi32(_mm_and_si128(r0, mask), _mm_srli_epi32(r0, 16));
+                t = _mm_add_epi32(t, _mm_add_epi32(_mm_and_si128(r1, mask), _mm_srli_epi32(r1, 16)));
+                t = _mm_srli_epi32(_mm_add_epi32(t, _mm_set1_epi32(2)), 2);
+                // sign extended, so that packs_epi32 keeps the values above 0x7FFF.
+                t = _mm_srai_epi32(_mm_slli_epi32(t, 16), 16);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x / 2), _mm_packs_epi32(t, t));
+            }
+            else
+            {
+                const __m128 t = _mm_add_ps(load<__m128>(s0 + x), load<__m128>(s1 + x));
+                const __m128 e = _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 0, 2, 0));
+                const __m128 o = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storel_pi(reinterpret_cast<__m64*>(dst + x / 2), _mm_mul_ps(_mm_add_ps(e, o), _mm_set1_ps(0.25f)));
+            }
+        }
+
+        if (width & 1)
+        {
+            const T a = reinterpret_cast<const T*>(s0)[width - 1];
+            const T b = reinterpret_cast<const T*>(s1)[width - 1];
+            if constexpr (std::is_integral_v<T>)
+                reinterpret_cast<T*>(dst)[width / 2] = static_cast<T>((a + a + b + b + 2) >> 2);
+            else
+                reinterpret_cast<T*>(dst)[width / 2] = ((a + b) + (a + b)) * 0.25f;
+        }
+    }
+}
+
+template <typename T, typename V>
+static F_INLINE void sort_pair(V& a, V& b)
+{
+    const V t = min<T>(a, b);
+    b = max<T>(a, b);
+    a = t;
+}
+
+// The center clipped to the MODE-th smallest and largest of its 8 neighbours (same network as spatial_c).
+template <typename T, int MODE, typename V>
+static F_INLINE V spatial_clip(const V& c, V* a)
+{
+    if constexpr (MODE == 1)
+    {
+        const V lo = min<T>(min<T>(min<T>(a[0], a[1]), min<T>(a[2], a[3])), min<T>(min<T>(a[4], a[5]), min<T>(a[6], a[7])));
+        const V hi = max<T>(max<T>(max<T>(a[0], a[1]), max<T>(a[2], a[3])), max<T>(max<T>(a[4], a[5]), max<T>(a[6], a[7])));
+        return clamp<T>(c, lo, hi);
+    }
+    else
+    {
+        sort_pair<T>(a[0], a[1]); sort_pair<T>(a[2], a[3]); sort_pair<T>(a[4], a[5]); sort_pair<T>(a[6], a[7]);
+        sort_pair<T>(a[0], a[2]); sort_pair<T>(a[1], a[3]); sort_pair<T>(a[4], a[6]); sort_pair<T>(a[5], a[7]);
+        sort_pair<T>(a[1], a[2]); sort_pair<T>(a[5], a[6]);
+        sort_pair<T>(a[0], a[4]); sort_pair<T>(a[1], a[5]); sort_pair<T>(a[2], a[6]); sort_pair<T>(a[3], a[7]);
+        sort_pair<T>(a[2], a[4]); sort_pair<T>(a[3], a[5]);
+        sort_pair<T>(a[1], a[2]); sort_pair<T>(a[3], a[4]); sort_pair<T>(a[5], a[6]);
+        return clamp<T>(c, a[MODE - 1], a[8 - MODE]);
+    }
+}
+
+// spatial: the whole row is processed by registers from column 0 (the sample before the row and the padding are read),
+// then the first and the last columns are restored.
+template <typename T, int MODE>
+void spatial_sse2(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+    constexpr int s = sizeof(T);
+    const int bwidth = width * s;
+
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t* dst = dstp + static_cast<size_t>(dstride) * y;
+        const uint8_t* s1 = srcp + static_cast<ptrdiff_t>(sstride) * y;
+        const uint8_t* s0 = s1 - sstride;
+        const uint8_t* s2 = s1 + sstride;
+
+        for (int x = 0; x < bwidth; x += 16)
+        {
+            V a[8] = {
+                loadu<V>(s0 + x - s), load<V>(s0 + x), loadu<V>(s0 + x + s),
+                loadu<V>(s1 + x - s), loadu<V>(s1 + x + s),
+                loadu<V>(s2 + x - s), load<V>(s2 + x), loadu<V>(s2 + x + s),
+            };
+            store(dst + x, spatial_clip<T, MODE>(load<V>(s1 + x), a));
+        }
+
+        reinterpret_cast<T*>(dst)[0] = reinterpret_cast<const T*>(s1)[0];
+        reinterpret_cast<T*>(dst)[width - 1] = reinterpret_cast<const T*>(s1)[width - 1];
+    }
+}
+
+// fast mode: the bound of a block of a half resolution row is computed once and used for two rows.
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_f_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    for (int k = 0; k < nrefs; ++k)
+        refp[k] = hrefp[k];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+    V d1buf[BLOCK_SIZE / 2 / sizeof(V)], d2buf[BLOCK_SIZE / 2 / sizeof(V)];
+
+    for (int y = 0; y < height; y += 2)
+    {
+        const int rows = min(height - y, 2);
+
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int x = x0 / 2; x < (x1 + 1) / 2; x += sizeof(V))
+            {
+                const V curx = load<V>(hcurrp + x);
+                V t0 = load<V>(refp[0] + x);
+                if constexpr (!AGGRESSIVE)
+                {
+                    V d = abs_diff<T, V>(curx, t0);
+                    for (int k = 1; k < nrefs; ++k)
+                        d = min<T>(d, abs_diff<T, V>(curx, load<V>(refp[k] + x)));
+                    d1buf[(x - x0 / 2) / sizeof(V)] = d;
+                }
+                else
+                {
+                    V t1 = max<T>(t0, curx);
+                    V t2 = cmpeq<T>(t0, t1);
+                    t0 = sub<T>(t1, min<T>(t0, curx));
+                    V d1 = and_reg(t2, t0);
+                    V d2 = andnot_reg(t2, t0);
+                    for (int k = 1; k < nrefs; ++k)
+                        update_diff<T, V>(load<V>(refp[k] + x), curx, d1, d2, zero);
+                    d1buf[(x - x0 / 2) / sizeof(V)] = d1;
+                    d2buf[(x - x0 / 2) / sizeof(V)] = d2;
+                }
+            }
+
+            const uint8_t* d1p = reinterpret_cast<const uint8_t*>(d1buf);
+            const uint8_t* d2p = AGGRESSIVE ? reinterpret_cast<const uint8_t*>(d2buf) : d1p;
+
+            for (int r = 0; r < rows; ++r)
+            {
+                const uint8_t* cur = currp + static_cast<size_t>(cstride) * r;
+                const uint8_t* prv0 = prevp + static_cast<size_t>(pstride) * r;
+                const uint8_t* nxt0 = nextp + static_cast<size_t>(nstride) * r;
+                uint8_t* dst = dstp + static_cast<size_t>(dstride) * r;
+                out.set_row(y + r);
+                for (int x = x0; x < x1; x += sizeof(V))
+                {
+                    const V curx = load<V>(cur + x);
+                    const V pr0 = load<V>(prv0 + x);
+                    const V nx0 = load<V>(nxt0 + x);
+                    const V d1 = load_half<T, V>(d1p + (x - x0) / 2);
+                    const V d2 = load_half<T, V>(d2p + (x - x0) / 2);
+                    const V ul = max<T>(sub<T>(min<T>(pr0, nx0), d1), curx);
+                    const V ll = min<T>(add<T>(max<T>(pr0, nx0), d2), curx);
+                    const V avg = get_avg<T, V>(pr0, nx0, curx, q);
+                    out.bound(x, d1, d2);
+                    out(dst, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+                }
+            }
+        }
+        prevp += static_cast<size_t>(pstride) * 2;
+        nextp += static_cast<size_t>(nstride) * 2;
+        currp += static_cast<size_t>(cstride) * 2;
+        dstp += static_cast<size_t>(dstride) * 2;
+        hcurrp += hstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += hstride;
+    }
+}
+
+// causal mode: only the previous frames are read (n - max(strength, 2) .. n). The average and the clamp use n - 1,
+// the bound the frames before it: the symmetric routines with the next frames replaced by the previous ones.
+template <typename T, bool AGGRESSIVE, int STORE>
+void proc_p_sse2(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+
+    const uint8_t* refp[MAX_STRENGTH];
+    const int nrefs = max(strength, 2) - 1;
+    for (int k = 0; k < nrefs; ++k)
+        refp[k] = prevp[k + 1];
+    const uint8_t* prv0 = prevp[0];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x = 0; x < width; x += sizeof(V))
+        {
+            const V curx = load<V>(currp + x);
+            V t0 = load<V>(refp[0] + x);
+            V d1, d2;
+            if constexpr (!AGGRESSIVE)
+            {
+                d1 = abs_diff<T, V>(curx, t0);
+                for (int k = 1; k < nrefs; ++k)
+                    d1 = min<T>(d1, abs_diff<T, V>(curx, load<V>(refp[k] + x)));
+                d2 = d1;
+            }
+            else
+            {
+                V t1 = max<T>(t0, curx);
+                V t2 = cmpeq<T>(t0, t1);
+                t0 = sub<T>(t1, min<T>(t0, curx));
+                d1 = and_reg(t2, t0);
+                d2 = andnot_reg(t2, t0);
+                for (int k = 1; k < nrefs; ++k)
+                    update_diff<T, V>(load<V>(refp[k] + x), curx, d1, d2, zero);
+            }
+            const V pr0 = load<V>(prv0 + x);
+            const V ul = max<T>(sub<T>(pr0, d1), curx);
+            const V ll = min<T>(add<T>(pr0, d2), curx);
+            const V avg = get_avg<T, V>(pr0, pr0, curx, q);
+            out.bound(x, d1, d2);
+            out(dstp, x, clamp<T, V>(avg, ll, ul), curx, avg, pr0);
+        }
+        prv0 += pstride[0];
+        currp += cstride;
+        dstp += dstride;
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += pstride[k + 1];
+    }
+}
+
+// variants: the bounds of a block are built in the order of the strengths (n - 2, n + 2, then n - s and n + s),
+// each variant is written once the references of its strength are in: every reference row is read once for all of them.
+// The average and the min/max of n - 1 and n + 1 are kept with the first reference, a variant only adds its bound and clamps.
+template <typename T, int STORE>
+void proc_v_sse2(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept
+{
+    using V = std::conditional_t<std::is_integral_v<T>, __m128i, __m128>;
+
+    int strength = 1;
+    bool plain = false, aggressive = false;
+    for (int v = 0; v < nvariants; ++v)
+    {
+        strength = max(strength, variants[v].strength);
+        plain |= !variants[v].aggressive;
+        aggressive |= variants[v].aggressive;
+    }
+
+    // the references in the order of the strengths.
+    const uint8_t* refp[MAX_STRENGTH * 2 - 2];
+    int rstride[MAX_STRENGTH * 2 - 2];
+    int nrefs = 0;
+    for (int k = 1; k < max(strength, 2); ++k)
+    {
+        refp[nrefs] = prevp[k];
+        rstride[nrefs++] = pstride[k];
+        if (k < strength)
+        {
+            refp[nrefs] = nextp[k];
+            rstride[nrefs++] = nstride[k];
+        }
+    }
+    const uint8_t* prv0 = prevp[0];
+    const uint8_t* nxt0 = nextp[0];
+    uint8_t* dst[MAX_VARIANTS];
+    for (int v = 0; v < nvariants; ++v)
+        dst[v] = dstp[v];
+
+    width *= sizeof(T);
+
+    V q = set1<T, V>();
+    V zero = setzero<V>();
+    Output<T, STORE> out(op, width);
+    V dbuf[BLOCK_SIZE / sizeof(V)], d1buf[BLOCK_SIZE / sizeof(V)], d2buf[BLOCK_SIZE / sizeof(V)];
+    V lobuf[BLOCK_SIZE / sizeof(V)], hibuf[BLOCK_SIZE / sizeof(V)], avgbuf[BLOCK_SIZE / sizeof(V)];
+
+    for (int y = 0; y < height; ++y)
+    {
+        out.set_row(y);
+        for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE)
+        {
+            const int x1 = min(x0 + BLOCK_SIZE, width);
+
+            for (int k = 0; k < nrefs; ++k)
+            {
+                const uint8_t* r = refp[k];
+                if (k == 0)
+                {
+                    for (int x = x0; x < x1; x += sizeof(V))
+                    {
+                        const V curx = load<V>(currp + x);
+                        const V pr0 = load<V>(prv0 + x);
+                        const V nx0 = load<V>(nxt0 + x);
+                        lobuf[(x - x0) / sizeof(V)] = min<T>(pr0, nx0);
+                        hibuf[(x - x0) / sizeof(V)] = max<T>(pr0, nx0);
+                        avgbuf[(x - x0) / sizeof(V)] = get_avg<T, V>(pr0, nx0, curx, q);
+                        V t0 = load<V>(r + x);
+                        if (plain)
+                            dbuf[(x - x0) / sizeof(V)] = abs_diff<T, V>(curx, t0);
+                        if (aggressive)
+                        {
+                            V t1 = max<T>(t0, curx);
+                            V t2 = cmpeq<T>(t0, t1);
+                            t0 = sub<T>(t1, min<T>(t0, curx));
+                            d1buf[(x - x0) / sizeof(V)] = and_reg(t2, t0);
+                            d2buf[(x - x0) / sizeof(V)] = andnot_reg(t2, t0);
+                        }
+                    }
+                }
+                else
+                {
+                    for (int x = x0; x < x1; x += sizeof(V))
+                    {
+                        const V curx = load<V>(currp + x);
+                        const V t0 = load<V>(r + x);
+                        if (plain)
+                            dbuf[(x - x0) / sizeof(V)] = min<T>(dbuf[(x - x0) / sizeof(V)], abs_diff<T, V>(curx, t0));
+                        if (aggressive)
+                            update_diff<T, V>(t0, curx, d1buf[(x - x0) / sizeof(V)], d2buf[(x - x0) / sizeof(V)], zero);
+                    }
+                }
+
+                // the variants whose references are all in: strength s ends with reference max(2 * s - 3, 0).
+                for (int v = 0; v < nvariants; ++v)
+                {
+                    if (max(variants[v].strength * 2 - 3, 0) != k)
+                        continue;
+                    const V* d1p = variants[v].aggressive ? d1buf : dbuf;
+                    const V* d2p = variants[v].aggressive ? d2buf : dbuf;
+                    for (int x = x0; x < x1; x += sizeof(V))
+                    {
+                        const int i = (x - x0) / sizeof(V);
+                        const V curx = load<V>(currp + x);
+                        const V ul = max<T>(sub<T>(lobuf[i], d1p[i]), curx);
+                        const V ll = min<T>(add<T>(hibuf[i], d2p[i]), curx);
+                        out(dst[v], x, clamp<T, V>(avgbuf[i], ll, ul), curx, avgbuf[i], lobuf[i]);
+                    }
+                }
+            }
+        }
+        prv0 += pstride[0];
+        nxt0 += nstride[0];
+        currp += cstride;
+        for (int v = 0; v < nvariants; ++v)
+            dst[v] += dstride[v];
+        for (int k = 0; k < nrefs; ++k)
+            refp[k] += rstride[k];
+    }
+}
+
+#define INSTANTIATE(T, STORE) \
+    template void proc_sse2<T, 1, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_sse2<T, 2, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_sse2<T, 3, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_a_sse2<T, 1, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_a_sse2<T, 2, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_a_sse2<T, 3, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_r_sse2<T, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_ra_sse2<T, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_f_sse2<T, false, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept; \
+    template void proc_f_sse2<T, true, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t* prevp, const uint8_t* nextp, const uint8_t* hcurrp, const uint8_t** hrefp, int dstride, int cstride, int pstride, int nstride, int hstride, int nrefs, int width, int height, const OutputParams* op) noexcept; \
+    template void proc_p_sse2<T, false, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept; \
+    template void proc_p_sse2<T, true, STORE>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, const int* pstride, const int* nstride, int width, int height, int strength, const OutputParams* op) noexcept;
+
+INSTANTIATE(uint8_t, STORE_STREAM)
+INSTANTIATE(uint8_t, STORE_CACHED)
+INSTANTIATE(uint16_t, STORE_STREAM)
+INSTANTIATE(uint16_t, STORE_CACHED)
+INSTANTIATE(uint16_t, STORE_TO8)
+INSTANTIATE(uint16_t, STORE_TO16)
+INSTANTIATE(int16_t, STORE_STREAM)
+INSTANTIATE(int16_t, STORE_CACHED)
+INSTANTIATE(int16_t, STORE_TO8)
+INSTANTIATE(int16_t, STORE_TO16)
+INSTANTIATE(float, STORE_STREAM)
+INSTANTIATE(float, STORE_CACHED)
+INSTANTIATE(float, STORE_TO8)
+INSTANTIATE(float, STORE_TO16)
+INSTANTIATE(uint8_t, STORE_STREAM | STORE_STATS)
+INSTANTIATE(uint8_t, STORE_CACHED | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_STREAM | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_CACHED | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_TO8 | STORE_STATS)
+INSTANTIATE(uint16_t, STORE_TO16 | STORE_STATS)
+INSTANTIATE(int16_t, STORE_STREAM | STORE_STATS)
+INSTANTIATE(int16_t, STORE_CACHED | STORE_STATS)
+INSTANTIATE(int16_t, STORE_TO8 | STORE_STATS)
+INSTANTIATE(int16_t, STORE_TO16 | STORE_STATS)
+INSTANTIATE(float, STORE_STREAM | STORE_STATS)
+INSTANTIATE(float, STORE_CACHED | STORE_STATS)
+INSTANTIATE(float, STORE_TO8 | STORE_STATS)
+INSTANTIATE(float, STORE_TO16 | STORE_STATS)
+INSTANTIATE(uint8_t, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(uint8_t, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(uint8_t, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(uint8_t, STORE_CACHED | STORE_STATS | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(uint16_t, STORE_CACHED | STORE_STATS | STORE_BOUND)
+INSTANTIATE(int16_t, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(int16_t, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(int16_t, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(int16_t, STORE_CACHED | STORE_STATS | STORE_BOUND)
+INSTANTIATE(float, STORE_STREAM | STORE_BOUND)
+INSTANTIATE(float, STORE_CACHED | STORE_BOUND)
+INSTANTIATE(float, STORE_STREAM | STORE_STATS | STORE_BOUND)
+INSTANTIATE(float, STORE_CACHED | STORE_STATS | STORE_BOUND)
+
+#undef INSTANTIATE
+
+#define INSTANTIATE(T, STORE) \
+    template void proc_v_sse2<T, STORE>(uint8_t** dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, const int* dstride, int cstride, const int* pstride, const int* nstride, int width, int height, const Variant* variants, int nvariants, const OutputParams* op) noexcept;
+
+INSTANTIATE(uint8_t, STORE_STREAM)
+INSTANTIATE(uint8_t, STORE_CACHED)
+INSTANTIATE(uint16_t, STORE_STREAM)
+INSTANTIATE(uint16_t, STORE_CACHED)
+INSTANTIATE(int16_t, STORE_STREAM)
+INSTANTIATE(int16_t, STORE_CACHED)
+INSTANTIATE(float, STORE_STREAM)
+INSTANTIATE(float, STORE_CACHED)
+
+#undef INSTANTIATE
+
+template void decimate_sse2<uint8_t>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template void decimate_sse2<uint16_t>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+template void decimate_sse2<float>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+
+#define INSTANTIATE(T) \
+    template void spatial_sse2<T, 1>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept; \
+    template void spatial_sse2<T, 2>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept; \
+    template void spatial_sse2<T, 3>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept; \
+    template void spatial_sse2<T, 4>(uint8_t* dstp, const uint8_t* srcp, int dstride, int sstride, int width, int height) noexcept;
+
+INSTANTIATE(uint8_t)
+INSTANTIATE(uint16_t)
+INSTANTIATE(float)
 
-template void proc_a_sse2<uint8_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_sse2<uint16_t, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_sse2<float, 2>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+#undef INSTANTIATE
 
-template void proc_a_sse2<uint8_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_sse2<uint16_t, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
-template void proc_a_sse2<float, 3>(uint8_t* dstp, const uint8_t* currp, const uint8_t** prevp, const uint8_t** nextp, int dstride, int cstride, int* pstride, int* nstride, int width, int height) noexcept;
+#endif // REDUCEFLICKER_X86
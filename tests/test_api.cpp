@@ -0,0 +1,340 @@
+/*
+test_api.cpp
+
+This file is a part of ReduceFlicker.
+
+Checks the C interface (ReduceFlicker_API.h) against a plain scalar implementation of the filter:
+every bit depth, strength 1..8, both modes and every instruction set supported by the cpu.
+Returns 0 when all the checks pass. Links against the plugin library, e.g.
+
+    g++ -std=c++17 -O2 -Isrc tests/test_api.cpp -L. -lreduceflicker -o test_api && ./test_api
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ReduceFlicker_API.h"
+
+namespace {
+    int checks = 0;
+    int failures = 0;
+
+    void check(bool ok, const std::string& what)
+    {
+        ++checks;
+        if (!ok)
+        {
+            ++failures;
+            fprintf(stderr, "FAIL: %s\n", what.c_str());
+        }
+    }
+
+    // A sequence of planes with padded rows: a pattern that moves a little, noise, alternating brightness and a few outliers.
+    struct Sequence
+    {
+        int width, height, bits, size, pitch;
+        std::vector<std::vector<uint8_t>> frames;
+
+        Sequence(int w, int h, int b, int num_frames, unsigned seed) : width(w), height(h), bits(b), size(b == 8 ? 1 : b == 32 ? 4 : 2)
+        {
+            pitch = (width * size + 63) / 64 * 64 + 64;
+            std::mt19937 rng(seed);
+            const int peak = bits == 32 ? 255 : (1 << bits) - 1;
+            for (int n = 0; n < num_frames; ++n)
+            {
+                // 64 bytes of slack: the data of a frame starts at an aligned address.
+                frames.emplace_back(static_cast<size_t>(pitch) * height + 64);
+                const int offset = (n % 2 ? 1 : -1) * static_cast<int>(rng() % (peak / 32 + 2));
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        int v = (x * 7 + y * 3 + n) % (peak + 1) + offset + static_cast<int>(rng() % 5) - 2;
+                        if (rng() % 16 == 0)
+                            v = rng() % (peak + 1);
+                        set(n, x, y, std::clamp(v, 0, peak) / (bits == 32 ? 255.0 : 1.0));
+                    }
+                }
+            }
+        }
+
+        uint8_t* row(int n, int y) { return data(n) + static_cast<size_t>(pitch) * y; }
+        uint8_t* data(int n)
+        {
+            const uintptr_t p = reinterpret_cast<uintptr_t>(frames[n].data());
+            return frames[n].data() + ((64 - p % 64) % 64);
+        }
+
+        double get(int n, int x, int y)
+        {
+            const uint8_t* r = row(n, y);
+            return size == 1 ? r[x] : size == 2 ? reinterpret_cast<const uint16_t*>(r)[x] : reinterpret_cast<const float*>(r)[x];
+        }
+
+        void set(int n, int x, int y, double v)
+        {
+            uint8_t* r = row(n, y);
+            if (size == 1)
+                r[x] = static_cast<uint8_t>(v);
+            else if (size == 2)
+                reinterpret_cast<uint16_t*>(r)[x] = static_cast<uint16_t>(v);
+            else
+                reinterpret_cast<float*>(r)[x] = static_cast<float>(v);
+        }
+    };
+
+    // The filter as described by the original C routine, one pixel at a time.
+    // prev[k]/next[k] are the frames n -/+ (k + 1), clamped to the sequence.
+    double reference(Sequence& s, int n, int x, int y, int strength, bool aggressive)
+    {
+        const int last = static_cast<int>(s.frames.size()) - 1;
+        auto prev = [&](int k) { return s.get(std::max(n - k - 1, 0), x, y); };
+        auto next = [&](int k) { return s.get(std::min(n + k + 1, last), x, y); };
+
+        const double cur = s.get(n, x, y);
+        std::vector<double> refs;
+        for (int k = 1; k < std::max(strength, 2); ++k)
+        {
+            refs.push_back(prev(k));
+            if (k < strength)
+                refs.push_back(next(k));
+        }
+
+        // plain: the smallest difference. aggressive: the smallest one above and below, 0 once the references disagree.
+        double d1, d2;
+        if (aggressive)
+        {
+            d1 = refs[0] - cur >= 0 ? refs[0] - cur : 0;
+            d2 = refs[0] - cur >= 0 ? 0 : cur - refs[0];
+            for (size_t k = 1; k < refs.size(); ++k)
+            {
+                const double d = refs[k] - cur;
+                if (d >= 0)
+                {
+                    d2 = 0;
+                    d1 = std::min(d, d1);
+                }
+                else
+                {
+                    d1 = 0;
+                    d2 = std::min(-d, d2);
+                }
+            }
+        }
+        else
+        {
+            d1 = std::abs(cur - refs[0]);
+            for (size_t k = 1; k < refs.size(); ++k)
+                d1 = std::min(d1, std::abs(cur - refs[k]));
+            d2 = d1;
+        }
+
+        const double p = prev(0), q = next(0);
+        double avg;
+        if (s.bits == 32)
+        {
+            const float a = static_cast<float>(p), b = static_cast<float>(q), c = static_cast<float>(cur);
+            avg = (a + b + c + c) * 0.25f;
+        }
+        else
+        {
+            const int t = std::max((static_cast<int>(p) + static_cast<int>(q) + 1) / 2 - 1, 0);
+            avg = (t + static_cast<int>(cur) + 1) / 2;
+        }
+        const double upper = std::max(std::min(p, q) - d1, cur);
+        const double lower = std::min(std::max(p, q) + d2, cur);
+        return std::clamp(avg, lower, upper);
+    }
+
+    // Largest difference between the output frames first..last and the reference.
+    double compare(Sequence& src, Sequence& dst, int first, int last, int strength, bool aggressive)
+    {
+        double diff = 0;
+        for (int n = first; n <= last; ++n)
+            for (int y = 0; y < src.height; ++y)
+                for (int x = 0; x < src.width; ++x)
+                    diff = std::max(diff, std::abs(dst.get(n - first, x, y) - reference(src, n, x, y, strength, aggressive)));
+        return diff;
+    }
+
+    struct Pointers
+    {
+        std::vector<const uint8_t*> src;
+        std::vector<uint8_t*> dst;
+        std::vector<int> spitch, dpitch;
+
+        Pointers(Sequence& s, Sequence& d)
+        {
+            for (int n = 0; n < static_cast<int>(s.frames.size()); ++n)
+            {
+                src.push_back(s.data(n));
+                spitch.push_back(s.pitch);
+            }
+            for (int n = 0; n < static_cast<int>(d.frames.size()); ++n)
+            {
+                dst.push_back(d.data(n));
+                dpitch.push_back(d.pitch);
+            }
+        }
+    };
+
+    // -1: the cpu doesn't support opt (ReduceFlicker_Process rejects it).
+    bool supported(int opt)
+    {
+        Sequence s(16, 2, 8, 3, 1), d(16, 2, 8, 3, 1);
+        Pointers p(s, d);
+        return ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 3, 0, 2, 16, 2, 8, 1, 0, opt) == 0;
+    }
+
+    void test_process(int opt)
+    {
+        // 203: a tail of columns after the last whole vector of every instruction set.
+        const int bits[] = { 8, 10, 16, 32 };
+        for (const int b : bits)
+        {
+            Sequence src(203, 19, b, 13, b * 31 + opt);
+            for (int strength = 1; strength <= 8; ++strength)
+            {
+                for (int aggressive = 0; aggressive < 2; ++aggressive)
+                {
+                    const int first = 2, last = 10;
+                    Sequence dst(203, 19, b, last - first + 1, 0);
+                    Pointers p(src, dst);
+                    const int r = ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 13, first, last, src.width, src.height, b, strength, aggressive, opt);
+                    const std::string what = "Process bits=" + std::to_string(b) + " strength=" + std::to_string(strength) + " aggressive=" + std::to_string(aggressive) + " opt=" + std::to_string(opt);
+                    check(r == 0, what + ": returned " + std::to_string(r));
+                    // the float routines with FMA3 round the average once.
+                    check(compare(src, dst, first, last, strength, aggressive) <= (b == 32 ? 1e-6 : 0), what);
+                }
+            }
+        }
+    }
+
+    // Consecutive ranges join like segments: each output frame only depends on the sequence, not on the range.
+    void test_ranges(int opt)
+    {
+        Sequence src(96, 16, 8, 20, 7);
+        Sequence whole(96, 16, 8, 20, 0), head(96, 16, 8, 7, 0), tail(96, 16, 8, 13, 0);
+        Pointers pw(src, whole), ph(src, head), pt(src, tail);
+        ReduceFlicker_Process(pw.dst.data(), pw.dpitch.data(), pw.src.data(), pw.spitch.data(), 20, 0, 19, 96, 16, 8, 3, 1, opt);
+        ReduceFlicker_Process(ph.dst.data(), ph.dpitch.data(), ph.src.data(), ph.spitch.data(), 20, 0, 6, 96, 16, 8, 3, 1, opt);
+        ReduceFlicker_Process(pt.dst.data(), pt.dpitch.data(), pt.src.data(), pt.spitch.data(), 20, 7, 19, 96, 16, 8, 3, 1, opt);
+
+        bool same = true;
+        for (int n = 0; n < 20; ++n)
+            same &= memcmp(whole.data(n), n < 7 ? head.data(n) : tail.data(n - 7), static_cast<size_t>(whole.pitch) * whole.height) == 0;
+        check(same, "Process ranges 0..6 and 7..19 opt=" + std::to_string(opt));
+    }
+
+    // A batch gives the same output as a call per stream, whatever the number of threads.
+    void test_batch(int opt)
+    {
+        const int bits[] = { 8, 10, 16, 32 };
+        for (const int threads : { 1, 3 })
+        {
+            std::vector<Sequence> srcs, dsts;
+            for (int i = 0; i < 4; ++i)
+            {
+                srcs.emplace_back(67 + i * 20, 9 + i, bits[i], 5 + i * 3, i + 100);
+                dsts.emplace_back(67 + i * 20, 9 + i, bits[i], 5 + i * 3 - 1, 0);
+            }
+            std::vector<Pointers> ptrs;
+            std::vector<ReduceFlickerStream> streams;
+            for (int i = 0; i < 4; ++i)
+                ptrs.emplace_back(srcs[i], dsts[i]);
+            for (int i = 0; i < 4; ++i)
+            {
+                const int num_frames = static_cast<int>(srcs[i].frames.size());
+                streams.push_back({ ptrs[i].dst.data(), ptrs[i].dpitch.data(), ptrs[i].src.data(), ptrs[i].spitch.data(),
+                    num_frames, 1, num_frames - 1, srcs[i].width, srcs[i].height, bits[i], i + 1, i % 2 });
+            }
+
+            const std::string what = "ProcessBatch threads=" + std::to_string(threads) + " opt=" + std::to_string(opt);
+            check(ReduceFlicker_ProcessBatch(streams.data(), 4, threads, opt) == 0, what + ": returned an error");
+            for (int i = 0; i < 4; ++i)
+                check(compare(srcs[i], dsts[i], 1, static_cast<int>(srcs[i].frames.size()) - 1, i + 1, i % 2) <= (bits[i] == 32 ? 1e-6 : 0), what + " stream " + std::to_string(i));
+        }
+    }
+
+    // A raw 4:2:0 file: every plane of every frame is filtered.
+    void test_file(int opt)
+    {
+        const int width = 64, height = 32, num_frames = 9;
+        const int cw = width / 2, ch = height / 2;
+        Sequence y(width, height, 8, num_frames, 11), u(cw, ch, 8, num_frames, 12), v(cw, ch, 8, num_frames, 13);
+
+        const std::string src_path = "test_api_src.yuv", dst_path = "test_api_dst.yuv";
+        FILE* f = fopen(src_path.c_str(), "wb");
+        if (!f)
+        {
+            check(false, "ProcessFile: can't write " + src_path);
+            return;
+        }
+        for (int n = 0; n < num_frames; ++n)
+            for (Sequence* p : { &y, &u, &v })
+                for (int r = 0; r < p->height; ++r)
+                    fwrite(p->row(n, r), 1, p->width, f);
+        fclose(f);
+
+        const std::string what = "ProcessFile opt=" + std::to_string(opt);
+        check(ReduceFlicker_ProcessFile(src_path.c_str(), dst_path.c_str(), width, height, 420, 8, 3, 1, 2, opt) == 0, what + ": returned an error");
+
+        std::vector<uint8_t> out(static_cast<size_t>(width * height + cw * ch * 2) * num_frames);
+        f = fopen(dst_path.c_str(), "rb");
+        const bool read = f && fread(out.data(), 1, out.size(), f) == out.size();
+        if (f)
+            fclose(f);
+        remove(src_path.c_str());
+        remove(dst_path.c_str());
+        check(read, what + ": the output has the wrong size");
+        if (!read)
+            return;
+
+        double diff = 0;
+        const uint8_t* o = out.data();
+        for (int n = 0; n < num_frames; ++n)
+            for (Sequence* p : { &y, &u, &v })
+                for (int r = 0; r < p->height; ++r)
+                    for (int x = 0; x < p->width; ++x)
+                        diff = std::max(diff, std::abs(*o++ - reference(*p, n, x, r, 3, true)));
+        check(diff == 0, what);
+    }
+
+    void test_invalid()
+    {
+        Sequence s(16, 2, 8, 3, 1), d(16, 2, 8, 3, 1);
+        Pointers p(s, d);
+        check(ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 3, 0, 2, 16, 2, 8, 0, 0, 0) == -1, "strength 0 is rejected");
+        check(ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 3, 0, 2, 16, 2, 8, 9, 0, 0) == -1, "strength 9 is rejected");
+        check(ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 3, 0, 3, 16, 2, 8, 2, 0, 0) == -1, "last beyond the sequence is rejected");
+        check(ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 3, 0, 2, 16, 2, 12, 2, 0, -2) == -1, "opt -2 is rejected");
+        check(ReduceFlicker_Process(p.dst.data(), p.dpitch.data(), p.src.data(), p.spitch.data(), 3, 0, 2, 16, 2, 24, 2, 0, 0) == -1, "bits 24 is rejected");
+        check(ReduceFlicker_ProcessFile("test_api_missing.yuv", "test_api_out.yuv", 16, 16, 420, 8, 2, 0, 1, 0) == -1, "a missing file is rejected");
+    }
+}
+
+int main()
+{
+    for (int opt = 0; opt <= 2; ++opt)
+    {
+        if (!supported(opt))
+        {
+            printf("opt=%d isn't supported by this cpu, skipped\n", opt);
+            continue;
+        }
+        test_process(opt);
+        test_ranges(opt);
+        test_batch(opt);
+        test_file(opt);
+    }
+    test_invalid();
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures != 0;
+}
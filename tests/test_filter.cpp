@@ -0,0 +1,269 @@
+/*
+test_filter.cpp
+
+This file is a part of ReduceFlicker.
+
+Checks the AviSynth filter through a script environment: segments (first, last, afirst, alast) against a monolithic run,
+and the output cache (cache) against the filter without it.
+Needs AviSynth+ (avisynth.h and the avisynth library) and takes the path of the plugin. Returns 0 when all the checks pass:
+
+    g++ -std=c++17 -O2 -I/usr/local/include/avisynth tests/test_filter.cpp -lavisynth -o test_filter && ./test_filter ./libreduceflicker.so
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "avisynth.h"
+
+const AVS_Linkage* AVS_linkage = nullptr;
+
+namespace {
+    int checks = 0;
+    int failures = 0;
+
+    void check(bool ok, const std::string& what)
+    {
+        ++checks;
+        if (!ok)
+        {
+            ++failures;
+            fprintf(stderr, "FAIL: %s\n", what.c_str());
+        }
+    }
+
+    // BlankClip of the format with synthetic content: a pattern that moves a little, noise, alternating brightness
+    // and a few outliers. A frame only depends on its number, so a trimmed source has the same frames.
+    // changed: a frame whose content differs from the same source without it.
+    class Source : public GenericVideoFilter
+    {
+        unsigned seed;
+        int changed;
+
+    public:
+        Source(PClip blank, unsigned s, int c) : GenericVideoFilter(blank), seed(s), changed(c) {}
+
+        PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) override
+        {
+            PVideoFrame dst = env->NewVideoFrame(vi);
+            const int bits = vi.BitsPerComponent();
+            const int peak = bits == 32 ? 255 : (1 << bits) - 1;
+            const int planes[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+            std::mt19937 rng(seed * 7919 + n + (n == changed ? 1000 : 0));
+            const int offset = (n % 2 ? 1 : -1) * static_cast<int>(rng() % (peak / 32 + 2));
+
+            for (int i = 0; i < vi.NumComponents(); ++i)
+            {
+                const int plane = planes[i];
+                const int width = dst->GetRowSize(plane) / vi.ComponentSize();
+                for (int y = 0; y < dst->GetHeight(plane); ++y)
+                {
+                    uint8_t* row = dst->GetWritePtr(plane) + static_cast<size_t>(dst->GetPitch(plane)) * y;
+                    for (int x = 0; x < width; ++x)
+                    {
+                        int v = (x * 7 + y * 3 + i * 50 + n) % (peak + 1) + offset + static_cast<int>(rng() % 5) - 2;
+                        if (rng() % 16 == 0)
+                            v = rng() % (peak + 1);
+                        v = std::clamp(v, 0, peak);
+                        if (bits == 8)
+                            row[x] = static_cast<uint8_t>(v);
+                        else if (bits <= 16)
+                            reinterpret_cast<uint16_t*>(row)[x] = static_cast<uint16_t>(v);
+                        else
+                            reinterpret_cast<float*>(row)[x] = v / 255.0f;
+                    }
+                }
+            }
+            return dst;
+        }
+    };
+
+    // Invokes a function with the positional arguments first, then the named ones.
+    PClip invoke(IScriptEnvironment* env, const char* name, std::initializer_list<AVSValue> args, std::initializer_list<std::pair<const char*, AVSValue>> named = {})
+    {
+        std::vector<AVSValue> values(args);
+        std::vector<const char*> names(values.size(), nullptr);
+        for (const auto& a : named)
+        {
+            values.push_back(a.second);
+            names.push_back(a.first);
+        }
+        return env->Invoke(name, AVSValue(values.data(), static_cast<int>(values.size())), names.data()).AsClip();
+    }
+
+    PClip source(IScriptEnvironment* env, const char* pixel_type, int length, unsigned seed, int changed = -1)
+    {
+        PClip blank = invoke(env, "BlankClip", {}, { { "length", length }, { "width", 96 }, { "height", 40 }, { "pixel_type", pixel_type } });
+        return new Source(blank, seed, changed);
+    }
+
+    bool same_frame(PClip a, int na, PClip b, int nb, IScriptEnvironment* env)
+    {
+        PVideoFrame fa = a->GetFrame(na, env);
+        PVideoFrame fb = b->GetFrame(nb, env);
+        const VideoInfo& vi = a->GetVideoInfo();
+        const int planes[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+        for (int i = 0; i < vi.NumComponents(); ++i)
+        {
+            const int plane = planes[i];
+            for (int y = 0; y < fa->GetHeight(plane); ++y)
+            {
+                if (memcmp(fa->GetReadPtr(plane) + static_cast<size_t>(fa->GetPitch(plane)) * y,
+                    fb->GetReadPtr(plane) + static_cast<size_t>(fb->GetPitch(plane)) * y, fa->GetRowSize(plane)) != 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // The frames first..last of whole against the frames from..from + last - first of part.
+    bool same_frames(PClip whole, int first, int last, PClip part, int from, IScriptEnvironment* env)
+    {
+        bool same = true;
+        for (int n = first; n <= last; ++n)
+            same &= same_frame(whole, n, part, from + n - first, env);
+        return same;
+    }
+
+    // Segments of a clip, and chunks trimmed with the frames of the window around them, give the frames of a monolithic run.
+    void test_segments(IScriptEnvironment* env, const char* pixel_type, int strength, int cstrength, bool aggressive)
+    {
+        const int length = 40;
+        PClip src = source(env, pixel_type, length, strength * 10 + cstrength);
+        PClip whole = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "cstrength", cstrength }, { "aggressive", aggressive } });
+        const std::string what = std::string(pixel_type) + " strength=" + std::to_string(strength) + " cstrength=" + std::to_string(cstrength) + " aggressive=" + std::to_string(aggressive);
+
+        // the frames fetched beyond a chunk: max(strength, 2) previous, strength next (the widest of the planes).
+        const int window = std::max(strength, cstrength);
+        const int before = std::max(window, 2), after = window;
+
+        const std::pair<int, int> segments[] = { { 0, 12 }, { 13, 13 }, { 14, 36 }, { 37, 39 } };
+        for (const auto& s : segments)
+        {
+            const std::string seg = what + " segment " + std::to_string(s.first) + ".." + std::to_string(s.second);
+            PClip part = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "cstrength", cstrength }, { "aggressive", aggressive },
+                { "first", s.first }, { "last", s.second } });
+            check(part->GetVideoInfo().num_frames == s.second - s.first + 1, seg + ": number of frames");
+            check(same_frames(whole, s.first, s.second, part, 0, env), seg);
+
+            // a chunk of a distributed encode: the source trimmed to the segment and its window.
+            const int start = std::max(s.first - before, 0), end = std::min(s.second + after, length - 1);
+            PClip trimmed = invoke(env, "Trim", { src, start, end });
+            PClip chunk = invoke(env, "ReduceFlicker", { trimmed }, { { "strength", strength }, { "cstrength", cstrength }, { "aggressive", aggressive },
+                { "first", s.first - start }, { "last", s.second - start } });
+            check(same_frames(whole, s.first, s.second, chunk, 0, env), seg + " trimmed to " + std::to_string(start) + ".." + std::to_string(end));
+        }
+
+        // afirst/alast: a title inside a longer clip, the frames around it are never used.
+        const int afirst = 5, alast = 34;
+        PClip title = invoke(env, "ReduceFlicker", { invoke(env, "Trim", { src, afirst, alast }) }, { { "strength", strength }, { "cstrength", cstrength }, { "aggressive", aggressive } });
+        PClip inner = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "cstrength", cstrength }, { "aggressive", aggressive },
+            { "afirst", afirst }, { "alast", alast }, { "first", afirst }, { "last", alast } });
+        check(same_frames(title, 0, alast - afirst, inner, 0, env), what + " afirst/alast");
+        PClip tail = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "cstrength", cstrength }, { "aggressive", aggressive },
+            { "afirst", afirst }, { "alast", alast }, { "first", 20 }, { "last", alast } });
+        check(same_frames(title, 20 - afirst, alast - afirst, tail, 0, env), what + " afirst/alast segment 20.." + std::to_string(alast));
+    }
+
+    // cache: the frames of a later run are copied from the file when their source frames and the parameters match.
+    // Each run is a new filter, the previous one (and its mapping) is released first.
+    void test_cache(IScriptEnvironment* env, const char* pixel_type, int strength, bool aggressive)
+    {
+        const int length = 24;
+        const char* path = "test_filter_cache.bin";
+        remove(path);
+        const std::string what = std::string(pixel_type) + " cache strength=" + std::to_string(strength) + " aggressive=" + std::to_string(aggressive);
+
+        PClip src = source(env, pixel_type, length, strength);
+        PClip plain = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "aggressive", aggressive } });
+
+        {
+            // first run: every frame is filtered and stored.
+            PClip cached = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "aggressive", aggressive }, { "cache", path } });
+            check(same_frames(plain, 0, length - 1, cached, 0, env), what + ": first run");
+        }
+        {
+            // second run, backwards: every frame comes from the file.
+            PClip cached = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "aggressive", aggressive }, { "cache", path } });
+            bool same = true;
+            for (int n = length - 1; n >= 0; --n)
+                same &= same_frame(plain, n, cached, n, env);
+            check(same, what + ": second run");
+        }
+        {
+            // one source frame changed: the frames whose window holds it are filtered again, the others still match.
+            PClip edited = source(env, pixel_type, length, strength, 11);
+            PClip reference = invoke(env, "ReduceFlicker", { edited }, { { "strength", strength }, { "aggressive", aggressive } });
+            PClip cached = invoke(env, "ReduceFlicker", { edited }, { { "strength", strength }, { "aggressive", aggressive }, { "cache", path } });
+            check(same_frames(reference, 0, length - 1, cached, 0, env), what + ": changed source frame");
+        }
+        {
+            // another strength: the file is reset.
+            const int other = strength % 8 + 1;
+            PClip reference = invoke(env, "ReduceFlicker", { src }, { { "strength", other }, { "aggressive", aggressive } });
+            PClip cached = invoke(env, "ReduceFlicker", { src }, { { "strength", other }, { "aggressive", aggressive }, { "cache", path } });
+            check(same_frames(reference, 0, length - 1, cached, 0, env), what + ": other strength");
+        }
+        {
+            // a segment keeps its own frames in the file.
+            PClip part = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "aggressive", aggressive }, { "first", 8 }, { "last", 15 } });
+            for (int run = 0; run < 2; ++run)
+            {
+                PClip cached = invoke(env, "ReduceFlicker", { src }, { { "strength", strength }, { "aggressive", aggressive }, { "first", 8 }, { "last", 15 }, { "cache", path } });
+                check(same_frames(part, 0, 7, cached, 0, env), what + ": segment, run " + std::to_string(run + 1));
+            }
+        }
+        remove(path);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: test_filter <path of the plugin>\n");
+        return 2;
+    }
+
+    IScriptEnvironment* env = CreateScriptEnvironment(AVISYNTH_INTERFACE_VERSION);
+    if (!env)
+    {
+        fprintf(stderr, "can't create the AviSynth environment\n");
+        return 2;
+    }
+    AVS_linkage = env->GetAVSLinkage();
+
+    try
+    {
+        env->Invoke("LoadPlugin", AVSValue(argv[1]));
+
+        const char* pixel_types[] = { "YUV420P8", "YUV420P10", "YUV420P16", "YUV420PS" };
+        for (const char* pixel_type : pixel_types)
+        {
+            for (const int strength : { 1, 2, 3, 5, 8 })
+            {
+                test_segments(env, pixel_type, strength, strength, false);
+                test_segments(env, pixel_type, strength, strength, true);
+            }
+            test_segments(env, pixel_type, 2, 5, false);
+            test_cache(env, pixel_type, 3, false);
+            test_cache(env, pixel_type, 8, true);
+        }
+    }
+    catch (const AvisynthError& e)
+    {
+        check(false, std::string("AviSynth error: ") + e.msg);
+    }
+
+    env->DeleteScriptEnvironment();
+    AVS_linkage = nullptr;
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures != 0;
+}